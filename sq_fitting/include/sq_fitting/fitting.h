@@ -3,39 +3,74 @@
 #include <iostream>
 #include <sq_fitting/sq.h>
 #include <sq_fitting/utils.h>
+#include <sq_fitting/fitting_context.h>
+#include <sq_fitting/moment_table.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/common/centroid.h>
 #include <pcl/common/pca.h>
+#include <atomic>
 
 //typedef
 typedef pcl::PointXYZRGB PointT;
 
 /**
- * @brief class for fitting superquadric parameters on point cloud data
+ * @brief class for fitting superquadric parameters on point cloud data. Only the xyz of the
+ * points are read, it is instantiated for pcl::PointXYZ, pcl::PointXYZRGB and pcl::PointNormal
  */
-class SuperquadricFitting{
+template<typename PointType>
+class SuperquadricFittingT{
 public:
 
   /**
-   * @brief Copy Constructor
-   * @param src
+   * @brief statistics of the last call to fit(), summed over every minimization of the fit
    */
-  SuperquadricFitting(const SuperquadricFitting &src) {}
+  struct FitReport
+  {
+    ///Levenberg-Marquardt iterations
+    int iterations;
+    ///evaluations of the residuals
+    int function_evaluations;
+    ///evaluations of the jacobian
+    int jacobian_evaluations;
+    ///minimum error, see getMinError
+    double final_error;
+    ///reason the minimization of the fitted superquadric stopped
+    std::string termination;
+    ///wall time in s of the pre alignment, summed over the multi start hypotheses
+    double prealign_time;
+    ///wall time in s of Levenberg-Marquardt, summed over the multi start hypotheses
+    double lm_time;
+    ///wall time in s of the error evaluation, summed over the multi start hypotheses
+    double error_time;
+    ///primitive which started Levenberg-Marquardt, see setPrimitives, moments for the moment
+    ///table start, none if not used
+    std::string primitive;
+    ///wall time in s of the primitive fits
+    double primitive_time;
+    ///number of points of the input cloud
+    int n_points;
+
+    FitReport() : iterations(0), function_evaluations(0), jacobian_evaluations(0), final_error(0),
+      termination("none"), prealign_time(0), lm_time(0), error_time(0), primitive("none"), primitive_time(0),
+      n_points(0) {}
+
+    /**
+     * @brief adds the evaluations and times of another report, keeps the termination of this one
+     */
+    void add(const FitReport& other);
+  };
 
   /**
    * @brief Constructor initialize by point cloud data
    * @param input_cloud
    */
-  SuperquadricFitting(const pcl::PointCloud<PointT>::Ptr& input_cloud);
+  SuperquadricFittingT(const typename pcl::PointCloud<PointType>::Ptr& input_cloud);
 
   /**
-   * @brief overloading operator
-   * @param src
-   * @return
+   * @brief Destructor, returns the buffers borrowed from the context
    */
-  SuperquadricFitting& operator = (const SuperquadricFitting &src){}
-  //virtual ~SuperquadricFitting();
+  virtual ~SuperquadricFittingT();
 
   /**
    * @brief setting pre align axis
@@ -61,13 +96,95 @@ public:
   /**
    * @brief fit param on different preAlign axis and set minimum param and minimum error
    */
-  void fit();
+  virtual void fit();
+
+  /**
+   * @brief starts a resumable fit, which step() advances. Pre aligns the cloud and starts
+   * Levenberg-Marquardt on the normal equations from the initial guess if there is one, on
+   * the pyramid levels if set. Multi start, the solver and the precision are not used
+   */
+  void initStep();
+
+  /**
+   * @brief runs at most n Levenberg-Marquardt iterations of the fit started by initStep()
+   * @param n
+   * @return true if the fit is finished, minimum param, error and report are then set as by fit()
+   */
+  bool step(int n);
+
+  /**
+   * @brief obtain the superquadric with the minimum error so far of the fit started by initStep()
+   * @param param
+   * @return false, leaving param unchanged, if no fit was started by initStep() since the
+   * construction or the last setContext()
+   */
+  bool getCurrentBest(sq_fitting::sq& param);
+
+  /**
+   * @brief fit() tries each pre align axis as the z axis of the superquadric concurrently
+   * and keeps the hypothesis with minimum error. A hypothesis converging above the cost of one
+   * that already finished is abandoned, unless the robust loss scale is estimated per fit
+   * @param multi_start
+   * @param rotated also try each axis rotated by 45 degrees about z, for cross sections
+   * with ambiguous principal axes
+   */
+  void setMultiStart(bool multi_start, bool rotated = false);
+
+  /**
+   * @brief fit on a pyramid of voxel downsampled clouds, from coarse to fine, warm starting
+   * every level with the solution of the previous one
+   * @param point_budgets maximum number of points of each level from coarse to fine, a value
+   * <= 0 uses all points. Empty fits on all points
+   */
+  void setPyramid(const std::vector<int>& point_budgets);
+
+  /**
+   * @brief start Levenberg-Marquardt from a previous fit of the same object instead of the
+   * pre aligned cloud, fit() then skips the multi start hypotheses
+   * @param guess superquadric in the frame of the input cloud
+   */
+  void setInitialGuess(const sq_fitting::sq& guess);
+
+  /**
+   * @brief fit() and initStep() first fit primitives with fixed exponents on the pre aligned cloud
+   * in closed form: a least squares ellipsoid, the bounding box and the cylinders along each
+   * of its axes. Levenberg-Marquardt starts from the primitive with minimum error, or is skipped
+   * with termination primitive if it is close enough. Not used with an initial guess, a support
+   * plane or multi start, nor by RobustSuperquadricFitting
+   * @param primitives
+   * @param max_distance in m, a primitive whose rms distance of the points to its surface along
+   * their rays is below it is the fit
+   */
+  void setPrimitives(bool primitives, double max_distance = 0.002);
+
+  /**
+   * @brief fit() and initStep() start Levenberg-Marquardt from the exponents, sizes and axis
+   * the table gives for the moments of the pre aligned cloud instead of e1 = e2 = 1, and with
+   * setPrimitives from the closer of it and the primitives. Not used with an initial guess,
+   * a support plane or multi start
+   * @param table loaded table, not copied, NULL to not use one
+   */
+  void setMomentTable(const sq::MomentTable* table);
+
+  /**
+   * @brief adds to the radial residuals of every point the misalignment of its observed normal
+   * with the normal of the superquadric, see sq::sq_normal_residual, which constrains the
+   * orientation and exponents on partial views. Used by the normal equations solver, which is
+   * then forced, on every pyramid level and multi start hypothesis of fit() and initStep() and
+   * on the inliers of RobustSuperquadricFitting. Not used on its random subsets, where the
+   * solver is not forced, nor in getJacobian
+   * @param normals normals of the points of the input cloud, in the same order, NaN normals are
+   * skipped. NULL to not use normals
+   * @param weight in m, a normal at 90 degrees of the superquadric normal costs as much as a
+   * point this far from the surface along its ray. <= 0 to not use normals
+   */
+  void setNormals(const pcl::PointCloud<pcl::Normal>::ConstPtr& normals, double weight);
 
   /**
    * @brief obtain the pre aligned cloud
    * @param cloud
    */
-  void getPreAlignedCloud(pcl::PointCloud<PointT>::Ptr& cloud);
+  void getPreAlignedCloud(typename pcl::PointCloud<PointType>::Ptr& cloud);
 
   /**
    * @brief obtain minimum params
@@ -81,6 +198,12 @@ public:
    */
   void getMinError(double& error);
 
+  /**
+   * @brief obtain the statistics of the last fit
+   * @param report
+   */
+  void getReport(FitReport& report);
+
   /**
    * @brief setting pose estimation method
    * @param method pca/iteration
@@ -88,17 +211,427 @@ public:
    */
   bool set_pose_est_method(const std::string method);
 
+  /**
+   * @brief setting the jacobian method used by Levenberg-Marquardt
+   * @param method analytic/autodiff/numerical, autodiff differentiates sq::sq_residual
+   * with dual numbers
+   * @return
+   */
+  bool set_jacobian_method(const std::string method);
 
+  /**
+   * @brief setting the linear solver of Levenberg-Marquardt
+   * @param solver qr/normal, qr factorizes the (number of points x 11) jacobian, normal accumulates
+   * J^T J and J^T r over blocks of points without storing the jacobian and solves the 11x11 system.
+   * The numerical jacobian always uses qr
+   * @return
+   */
+  bool set_solver(const std::string solver);
 
-private:
-  pcl::PointCloud<PointT>::Ptr cloud_;
-  pcl::PointCloud<PointT>::Ptr prealigned_cloud_;
+  /**
+   * @brief setting the precision of the residuals and the analytic jacobian
+   * @param precision double/float, float evaluates them with the single precision kernels, on
+   * twice the lanes and half the memory, and polishes every minimization with a few double
+   * precision iterations. The autodiff and numerical jacobians always use double
+   * @return
+   */
+  bool set_precision(const std::string precision);
+
+  /**
+   * @brief setting the parameterization of the rotation updated by Levenberg-Marquardt
+   * @param rotation euler/so3. euler steps the angles ax, ay, az of rx * rz * ry, which loses a
+   * degree of freedom at az = +-90 degrees. so3 steps a rotation vector composed on the left of the
+   * current rotation, the jacobian is the analytic one re-linearised at every estimate and it uses
+   * the normal equations solver. The autodiff and numerical jacobians and fits on a support plane
+   * always use euler
+   * @return
+   */
+  bool set_rotation(const std::string rotation);
+
+  /**
+   * @brief setting the accuracy of the powers in the residuals of Levenberg-Marquardt, see
+   * sq::KernelAccuracy. Errors are evaluated with the default accuracy, sq::sq_kernel_accuracy
+   * @param accuracy full/high/fast, sq::sq_kernel_accuracy() by default
+   * @return
+   */
+  bool set_kernel_accuracy(const std::string accuracy);
+
+  /**
+   * @brief restrict Levenberg-Marquardt to a box instead of clamping e1 and e2 in the residual:
+   * e1 and e2 in [0.1, 1.9], the sizes between min_size and max_size and every translation
+   * component within the distance of the centroid of the points to their origin plus the distance
+   * of the farthest point to the centroid, which bounds the norm of the translation. Steps are
+   * projected on the box and unknowns on a bound with the gradient pointing out of the box are
+   * held, which uses the normal equations solver. The numerical jacobian is not bounded
+   * @param bounded
+   * @param min_size in m
+   * @param max_size in m, <= 0 uses the distance of the farthest point to the centroid
+   */
+  void setBounds(bool bounded, double min_size = 0.005, double max_size = 0.);
+
+  /**
+   * @brief fit an object standing on a support plane with fewer degrees of freedom: the z axis
+   * of the superquadric stays along the normal of the plane, only the yaw about it and the
+   * translation are fitted. The cloud is pre aligned on the plane instead of its principal axes,
+   * fit() skips the multi start hypotheses and Levenberg-Marquardt uses the normal equations
+   * solver with the euler rotation. The numerical jacobian is not constrained
+   * @param plane coefficients a, b, c, d of ax + by + cz + d = 0 in the frame of the input cloud
+   * @param tangent also keep the bottom of the superquadric on the plane, leaving the height
+   * of its center to a3
+   */
+  void setSupportPlane(const Eigen::Vector4d& plane, bool tangent = false);
+
+  /**
+   * @brief fit the cloud as if it was completed by its reflection through the center of its
+   * bounding box, as SQFitter::mirror_cloud does, without the mirrored points. A superquadric
+   * is symmetric about its center, so a point and its reflection have the same residual once
+   * the center is the center of reflection: the cloud is pre aligned about that center, which
+   * is held, and only the sizes, exponents and rotation are fitted with the normal equations
+   * solver. Primitive and moment table starts are not used. Ignored with a support plane.
+   * The numerical jacobian is not constrained
+   * @param symmetric
+   */
+  void setSymmetric(bool symmetric);
+
+  /**
+   * @brief setting the loss applied to the squared radial residuals
+   * @param loss squared/huber/cauchy
+   * @return
+   */
+  bool set_loss(const std::string loss);
+
+  /**
+   * @brief scale of the huber/cauchy loss in units of the radial residual
+   * @param scale <= 0 estimates it from the median residual at the start of every minimization
+   */
+  void setLossScale(double scale);
+
+  /**
+   * @brief take the buffers and workspaces of the fit from a context reused by the fits of a
+   * thread instead of allocating them for every fit. The pre aligned buffers are borrowed from
+   * the context until the fitting is destroyed or gets another context, and every fit() and
+   * initStep() resets its arena. With the normal equations solver and without a pyramid, once
+   * the context has grown to the largest object, Levenberg-Marquardt and the fitted cloud
+   * buffers do not allocate
+   * @param context used by one fitting at a time and outliving it, NULL to use a context of the
+   * fitting
+   */
+  void setContext(sq::FittingContext* context);
+
+  /**
+   * @brief clouds with at least this number of points evaluate residuals and jacobians of a
+   * single fit concurrently on sq::ThreadPool. The result does not depend on it
+   * @param points default sq::SQ_PARALLEL_POINTS
+   */
+  void setParallelThreshold(int points);
+
+  /**
+   * @brief evaluates the jacobian of the radial residual on the pre aligned cloud
+   * with the current jacobian method, w.r.t. the rotation vector of set_rotation for so3
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   * @param fjac jacobian (number of points x 11)
+   */
+  void getJacobian(const Eigen::VectorXd& xvec, Eigen::MatrixXd& fjac);
+
+protected:
+  typename pcl::PointCloud<PointType>::Ptr cloud_;
+  ///context of the fit, own_context_ unless set, see setContext
+  sq::FittingContext* context_;
+  sq::FittingContext own_context_;
+  ///structure of arrays copy of cloud_ after pre alignment, evaluated in place by the functor,
+  ///borrowed from the context
+  sq::PointBuffer prealigned_points_;
+  ///transformation from cloud_ to the pre aligned points
+  Eigen::Affine3f prealign_transform_;
   sq_fitting::sq params_;
   bool pre_align_;
   int pre_align_axis_;
   double min_error_;
   std::string pose_est_method_;
   bool set_method_;
+  ///jacobian methods and robust losses, resolved from their names once by the setters
+  enum JacobianMethod
+  {
+    JACOBIAN_ANALYTIC = 0,
+    JACOBIAN_AUTODIFF,
+    JACOBIAN_NUMERICAL
+  };
+  enum Loss
+  {
+    LOSS_SQUARED = 0,
+    LOSS_HUBER,
+    LOSS_CAUCHY
+  };
+  JacobianMethod jacobian_method_;
+  bool multi_start_;
+  bool multi_start_rotated_;
+  std::vector<int> pyramid_budgets_;
+  bool has_initial_guess_;
+  sq_fitting::sq initial_guess_;
+  Loss loss_;
+  double loss_scale_;
+  ///solver normal, precision float and rotation so3 of the setters
+  bool normal_solver_;
+  bool float_precision_;
+  bool so3_rotation_;
+  sq::KernelAccuracy kernel_accuracy_;
+  std::size_t parallel_threshold_;
+  bool bounded_;
+  double min_size_;
+  double max_size_;
+  bool has_support_plane_;
+  ///normalized support plane in the frame of the input cloud, see setSupportPlane
+  Eigen::Vector4d support_plane_;
+  bool support_tangent_;
+  bool symmetric_;
+  ///see statistics()
+  sq::CloudStatistics statistics_;
+  bool has_statistics_;
+  bool primitives_;
+  double primitive_distance_;
+  const sq::MomentTable* moment_table_;
+  pcl::PointCloud<pcl::Normal>::ConstPtr normals_;
+  double normal_weight_;
+  ///normals_ rotated like prealigned_points_, zero for NaN normals, empty without normals,
+  ///borrowed from the context
+  sq::PointBuffer prealigned_normals_;
+  FitReport report_;
+
+  typedef Eigen::Matrix<double, 11, 11> Matrix11d;
+  typedef Eigen::Matrix<double, 11, 1> Vector11d;
+
+  ///maximum number of iterations of a minimization
+  enum {MAX_ITERATIONS = 400};
+
+  /**
+   * @brief Levenberg-Marquardt on the normal equations between two iterations
+   */
+  struct NormalState
+  {
+    Vector11d x;
+    Matrix11d JtJ;
+    Vector11d Jtr;
+    ///diagonal damping, the largest diagonal of J^T J so far
+    Vector11d scale;
+    double cost;
+    double lambda;
+    double nu;
+    ///the rotation unknowns step a rotation vector on the left of the rotation, see set_rotation
+    bool local_rotation;
+    ///box of the unknowns if bounded, see setBounds
+    bool bounded;
+    Vector11d lower;
+    Vector11d upper;
+    ///the unknowns step x + basis * s in the subspace of the support plane, see setSupportPlane
+    bool constrained;
+    Matrix11d basis;
+    int iterations;
+    ///NULL while iterating, then the termination reason
+    const char* termination;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /**
+   * @brief resumable fit of initStep() and step()
+   */
+  struct StepState
+  {
+    ///pyramid level being minimized, see setPyramid
+    std::size_t level;
+    bool last_level;
+    ///points of the level, level_points of the context or the pre aligned points
+    const sq::PointBuffer* points;
+    ///normals of points, level_normals of the context or the pre aligned normals
+    const sq::PointBuffer* normals;
+    double loss_scale;
+    NormalState lm;
+    ///initStep() was called, lm.x holds a fit
+    bool started;
+    bool finished;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+  StepState step_;
+
+  /**
+   * @brief sum of the squared residuals and normal equations of a range of points
+   */
+  struct NormalEquations
+  {
+    Matrix11d JtJ;
+    Vector11d Jtr;
+    double cost;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /**
+   * @brief pre align hypothesis of the multi start fitting
+   */
+  struct Hypothesis
+  {
+    ///transformation from cloud_ to points
+    Eigen::Affine3f transform;
+    Eigen::Vector3f variances;
+    ///pre aligned points and normals of the context of the hypothesis
+    sq::PointBuffer* points;
+    sq::PointBuffer* normals;
+    sq_fitting::sq param;
+    double error;
+    FitReport report;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  /**
+   * @brief pre aligns the input cloud into prealigned_points_
+   * @param transform_inv transformation from input cloud to pre aligned cloud
+   * @param variances
+   */
+  void computePreAlignedCloud(Eigen::Affine3f& transform_inv, Eigen::Vector3f& variances);
+
+  /**
+   * @brief resets report_ to a default report
+   */
+  void resetReport();
+
+  /**
+   * @brief swaps the pre aligned buffers with the ones of the context, lending them to the
+   * fitting or returning them
+   */
+  void exchangeBuffers();
+
+  /**
+   * @brief rotates the normals into aligned, or clears it without normals
+   * @param transform_inv transformation from input cloud to the pre aligned points
+   * @param aligned prealigned_normals_ or the normals of a multi start hypothesis
+   */
+  void alignNormals(const Eigen::Affine3f& transform_inv, sq::PointBuffer& aligned);
+
+  /**
+   * @brief pre aligns the input cloud on the support plane: the origin is the centroid
+   * projected on the plane, z the normal towards the centroid and x, y the principal axes
+   * of the points in the plane
+   * @param transform transformation from input cloud to pre aligned cloud
+   * @param variances initial size of the superquadric, z is a sixth of the highest point
+   */
+  void supportAlign(Eigen::Affine3f& transform, Eigen::Vector3f& variances);
+
+  /**
+   * @brief projects the unknowns on the support plane constraints, the rotation keeps only
+   * its yaw about the normal and for a tangent plane tz = -a3
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   */
+  void supportParameters(Eigen::Ref<Eigen::VectorXd> xvec) const;
+
+  /**
+   * @brief true if the fit is symmetric about the center of reflection, see setSymmetric
+   */
+  bool symmetric() const;
+
+  /**
+   * @brief moves the origin of the pre aligned points to the center of reflection, the center
+   * of the bounding box of the input cloud, see setSymmetric
+   * @param transform_inv transformation from input cloud to the pre aligned points
+   */
+  void symmetryAlign(Eigen::Affine3f& transform_inv);
+
+  /**
+   * @brief centroid, covariance and bounding box of the input cloud, computed in one pass on
+   * the first call and shared by the pre alignments
+   */
+  const sq::CloudStatistics& statistics();
+
+  /**
+   * @brief runs Levenberg-Marquardt on pre aligned points
+   * @param points pre aligned points
+   * @param normals normals of the pre aligned points, NULL or empty without normals
+   * @param transform_inv transformation from input cloud to the pre aligned points
+   * @param variances initial size of the superquadric
+   * @param param fitted superquadric in the frame of the input cloud
+   * @param param_lm fitted superquadric in the frame of the pre aligned points
+   * @param report statistics of the minimization are added to it
+   * @param context workspaces of the minimization
+   * @param best_cost if not NULL, best final cost of the multi start hypotheses, see minimize
+   */
+  void fitPreAligned(const sq::PointBuffer& points, const sq::PointBuffer* normals,
+                     const Eigen::Affine3f& transform_inv,
+                     const Eigen::Vector3f& variances, sq_fitting::sq& param, sq_fitting::sq& param_lm,
+                     FitReport& report, sq::FittingContext& context, std::atomic<double>* best_cost = NULL);
+
+  /**
+   * @brief starting point of Levenberg-Marquardt, the initial guess if there is one
+   * @param transform_inv transformation from input cloud to the pre aligned points
+   * @param variances initial size of the superquadric
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   */
+  void initialParameters(const Eigen::Affine3f& transform_inv, const Eigen::Vector3f& variances,
+                         Vector11d& xvec);
+
+  /**
+   * @brief runs Levenberg-Marquardt on every level of the pyramid, see setPyramid. The normals
+   * are downsampled with the points
+   * @param best_cost if not NULL, passed to the minimization of the last level, see minimize
+   */
+  void minimizePyramid(const sq::PointBuffer& points, const sq::PointBuffer* normals, Vector11d& xvec,
+                       FitReport& report, sq::FittingContext& context, std::atomic<double>* best_cost = NULL);
+
+  /**
+   * @brief converts the Levenberg-Marquardt parameters to superquadrics
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   * @param transform_inv transformation from input cloud to the pre aligned points
+   * @param param superquadric in the frame of the input cloud
+   * @param param_lm superquadric in the frame of the pre aligned points
+   */
+  void vectorToParam(const Vector11d& xvec, const Eigen::Affine3f& transform_inv,
+                     sq_fitting::sq& param, sq_fitting::sq& param_lm);
+
+  /**
+   * @brief runs Levenberg-Marquardt on the points starting from xvec
+   * @param points pre aligned points
+   * @param normals normals of the points, NULL or empty without normals
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   * @param report evaluations and wall time are added to it, the termination is replaced
+   * @param context workspaces of the minimization
+   * @param best_cost if not NULL, lowest mean squared residual at which a multi start hypothesis
+   * finished. The minimization is abandoned, with termination abandoned, once it is above it
+   * and fell by less than 1% over the last 5 accepted steps, converging to a worse minimum.
+   * Otherwise it lowers best_cost when it finishes
+   */
+  void minimize(const sq::PointBuffer& points, const sq::PointBuffer* normals, Vector11d& xvec,
+                FitReport& report, sq::FittingContext& context, std::atomic<double>* best_cost = NULL);
+
+  /**
+   * @brief scale of the loss estimated from the median absolute radial residual
+   * @param arena holds the residuals
+   */
+  double robustScale(const sq::PointBuffer& points, const Vector11d& xvec, sq::Arena& arena);
+
+  /**
+   * @brief starting point of Levenberg-Marquardt for multi start hypothesis i, with the
+   * hypothesis rotation in the pose parameters instead of the points
+   * @param i pre align axis moved on z
+   * @param rotated rotated by 45 degrees about z
+   * @param variances initial size of the superquadric
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   */
+  void hypothesisParameters(const int i, const bool rotated, const Eigen::Vector3f& variances,
+                            Vector11d& xvec);
+
+  /**
+   * @brief starting point of Levenberg-Marquardt on prealigned_points_, the primitive or moment
+   * table start with minimum error if they are used, see setPrimitives and setMomentTable,
+   * otherwise initialParameters
+   * @param transform_inv transformation from input cloud to the pre aligned points
+   * @param variances initial size of the superquadric
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   * @param error error of the primitive, set if it is the fit
+   * @return true if the primitive is close enough to be the fit
+   */
+  bool startParameters(const Eigen::Affine3f& transform_inv, const Eigen::Vector3f& variances,
+                       Vector11d& xvec, double& error);
+
+  /**
+   * @brief fits all hypotheses on the thread pool, see setMultiStart
+   */
+  void fitMultiStart();
 
   ///typename _scalar
   template<typename _Scalar, int nX = Eigen::Dynamic, int nY = Eigen::Dynamic>
@@ -134,11 +667,15 @@ private:
   {
     using Functor<double>::values;
 
-    OptimizationFunctor (int m_data_points, SuperquadricFitting *estimator)
-      :Functor<double> (m_data_points) , estimator_(estimator) {}
+    OptimizationFunctor (const sq::PointBuffer *points, const sq::PointBuffer *normals,
+                         SuperquadricFittingT *estimator)
+      :Functor<double> (points->size()) , points_(points), points_f_(NULL),
+        normals_(normals && !normals->x.empty() ? normals : NULL),
+        estimator_(estimator), arena_(&estimator->context_->arena), loss_scale_(1.) {}
 
     inline OptimizationFunctor(const OptimizationFunctor *src)
-      :Functor<double> (src->m_data_points_), estimator_()
+      :Functor<double> (src->m_data_points_), points_(), points_f_(), normals_(), estimator_(), arena_(),
+        loss_scale_(1.)
     {
       *this = src;
     }
@@ -149,20 +686,126 @@ private:
     inline OptimizationFunctor& operator = (const OptimizationFunctor &src)
     {
       Functor<double>::operator=(src);
+      points_ = src.points_;
+      points_f_ = src.points_f_;
+      normals_ = src.normals_;
       estimator_ = src.estimator_;
+      arena_ = src.arena_;
+      loss_scale_ = src.loss_scale_;
       return (*this);
     }
 
+    /**
+     * @brief residuals, chunks of points are evaluated concurrently above the parallel threshold
+     * of the estimator, as the jacobian in df
+     */
     int operator () (const Eigen::VectorXd &xvec, Eigen::VectorXd &fvec) const;
 
     int df(const Eigen::VectorXd &xvec, Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> &fjac) const;
 
-    SuperquadricFitting* estimator_;
+    /**
+     * @brief sum of the squared residuals, and the normal equations J^T J and J^T r if they are
+     * not NULL. Chunks of points are accumulated concurrently into sums taken from the arena and
+     * reduced in chunk order
+     * @return sum of the squared residuals
+     */
+    double normalEquations(const Vector11d &xvec, Matrix11d* JtJ, Vector11d* Jtr) const;
+
+    /**
+     * @brief residuals of the n points from begin, with the robust loss of the estimator
+     * @param param kernel parameter of xvec
+     * @param residual n values
+     * @param grad if not NULL, jacobian of the residuals as structure of arrays, value k of
+     * point i is at grad[k * n + i]. The rotation columns are w.r.t. a rotation vector on the
+     * left of the rotation if the estimator steps it locally, see set_rotation
+     */
+    void evaluate(const Vector11d &xvec, const sq::SQKernelParam &param, const std::size_t begin,
+                  const std::size_t n, double* residual, double* grad) const;
+
+    /**
+     * @brief accumulates the points from begin to end in blocks that stay in cache
+     * @param jacobian also accumulate J^T J and J^T r
+     */
+    void accumulate(const Vector11d &xvec, const std::size_t begin, const std::size_t end,
+                    const bool jacobian, NormalEquations& sums) const;
+
+    /**
+     * @brief adds the normal residuals of the points from begin to end to the sums, with the
+     * squared loss
+     * @param jacobian also accumulate J^T J and J^T r
+     */
+    void accumulateNormals(const Vector11d &xvec, const std::size_t begin, const std::size_t end,
+                           const bool jacobian, NormalEquations& sums) const;
+
+    ///points evaluated at once in the l1 cache
+    enum {BLOCK_SIZE = 128};
+
+    ///pre aligned points the residuals are evaluated on
+    const sq::PointBuffer* points_;
+    ///if not NULL, single precision copy of points_ used instead of it
+    const sq::PointBufferf* points_f_;
+    ///if not NULL, normals of points_ whose misalignment is added to the normal equations
+    const sq::PointBuffer* normals_;
+    SuperquadricFittingT* estimator_;
+    ///arena of the chunk sums, of the context of the estimator unless minimized in another one
+    sq::Arena* arena_;
+    ///scale of the robust loss of the estimator
+    double loss_scale_;
 
   };
+
+  /**
+   * @brief Levenberg-Marquardt on the normal equations of the functor, see set_solver
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   * @param max_iterations
+   * @param tolerance relative reduction of the squared residuals and relative step to stop at
+   * @param report evaluations are added to it
+   * @param best_cost if not NULL, best final cost of the multi start hypotheses, see minimize
+   * @return the termination reason
+   */
+  const char* minimizeNormal(const OptimizationFunctor& functor, Vector11d& xvec, const int max_iterations,
+                             const double tolerance, FitReport& report, std::atomic<double>* best_cost = NULL);
+
+  /**
+   * @brief true if the rotation is stepped with a rotation vector, see set_rotation
+   */
+  bool localRotation() const;
+
+  /**
+   * @brief box of the unknowns on the points of the functor, see setBounds
+   */
+  void computeBounds(const OptimizationFunctor& functor, NormalState& state);
+
+  /**
+   * @brief evaluates the normal equations at xvec projected on the bounds, and resets the damping
+   */
+  void initNormal(const OptimizationFunctor& functor, const Vector11d& xvec, NormalState& state,
+                  FitReport& report);
+
+  /**
+   * @brief one damped Gauss-Newton step, the damping is increased if it does not reduce the error
+   * @return true if Levenberg-Marquardt stopped, see NormalState::termination
+   */
+  bool iterateNormal(const OptimizationFunctor& functor, const double tolerance, NormalState& state,
+                     FitReport& report);
+
+  /**
+   * @brief sets up the points of the current pyramid level of the resumable fit and starts
+   * Levenberg-Marquardt on them from xvec
+   */
+  void startLevel(const Vector11d& xvec);
+
+private:
+  ///not copyable, the buffers are borrowed from context_, which may be own_context_
+  SuperquadricFittingT(const SuperquadricFittingT&);
+  SuperquadricFittingT& operator = (const SuperquadricFittingT&);
+
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 };
 
+///fitting of the segmented clouds
+typedef SuperquadricFittingT<PointT> SuperquadricFitting;
+
 #endif // FITTING_LM_H
@@ -0,0 +1,136 @@
+#ifndef FITTING_CONTEXT_H
+#define FITTING_CONTEXT_H
+
+#include <sq_fitting/utils.h>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace sq {
+
+/**
+ * @brief bump allocator for the transient buffers of a fit. Allocations are taken from the end of
+ * a block and released all at once by rewind() or reset(). A request that does not fit opens a new
+ * block, and reset() merges the blocks into one as large as all of them, so that once the arena
+ * has grown to the largest fit it no longer allocates
+ */
+class Arena
+{
+public:
+  ///position of the arena, see mark()
+  struct Marker
+  {
+    std::size_t block;
+    std::size_t offset;
+  };
+
+  /**
+   * @brief rewinds the arena to where it was at construction when it goes out of scope
+   */
+  class Scope
+  {
+  public:
+    explicit Scope(Arena& arena) : arena_(arena), marker_(arena.mark()) {}
+    ~Scope() {arena_.rewind(marker_);}
+  private:
+    Scope(const Scope&);
+    Scope& operator = (const Scope&);
+    Arena& arena_;
+    Marker marker_;
+  };
+
+  /**
+   * @brief Constructor
+   * @param capacity bytes of the first block, allocated on the first allocation
+   */
+  explicit Arena(const std::size_t capacity = 0);
+
+  /**
+   * @brief uninitialized storage for n values, aligned on a cache line. The values are not
+   * destroyed, so T has to be trivially destructible
+   */
+  template<typename T>
+  T* allocate(const std::size_t n)
+  {
+    static_assert(std::is_trivially_destructible<T>::value, "arena values are not destroyed");
+    return static_cast<T*>(allocateBytes(n * sizeof(T)));
+  }
+
+  /**
+   * @brief current position, allocations after it are released by rewind()
+   */
+  Marker mark() const;
+
+  /**
+   * @brief releases the allocations made after the marker
+   */
+  void rewind(const Marker& marker);
+
+  /**
+   * @brief releases every allocation and merges the blocks
+   */
+  void reset();
+
+  /**
+   * @brief bytes of all blocks
+   */
+  std::size_t capacity() const;
+
+private:
+  ///alignment of every allocation
+  enum {ALIGNMENT = 64};
+
+  void* allocateBytes(std::size_t bytes);
+
+  std::vector<std::unique_ptr<char[]> > blocks_;
+  std::vector<std::size_t> sizes_;
+  ///block and offset of the next allocation
+  std::size_t block_;
+  std::size_t offset_;
+  std::size_t initial_capacity_;
+};
+
+/**
+ * @brief buffers and workspaces reused by the fits of one thread, so that fitting one object after
+ * another does not allocate once they have grown to the largest object. A context is used by one
+ * fit at a time, see SuperquadricFitting::setContext
+ */
+class FittingContext
+{
+public:
+  FittingContext();
+
+  ///transient buffers of a fit: chunk sums of the normal equations, residuals of the loss scale
+  Arena arena;
+  ///pre aligned points and normals, lent to the fitting using the context
+  PointBuffer prealigned_points;
+  PointBuffer prealigned_normals;
+  ///points and normals of the current pyramid level
+  PointBuffer level_points;
+  PointBuffer level_normals;
+  ///single precision copy of the points being minimized
+  PointBufferf points_f;
+
+  /**
+   * @brief context of multi start hypothesis i, fitted concurrently with the others, created on
+   * first use
+   */
+  FittingContext& hypothesis(const std::size_t i);
+
+  /**
+   * @brief releases the arenas of this context and of the hypotheses, keeping their memory. The
+   * buffers keep their capacity
+   */
+  void reset();
+
+private:
+  FittingContext(const FittingContext&);
+  FittingContext& operator = (const FittingContext&);
+
+  std::vector<std::unique_ptr<FittingContext> > hypotheses_;
+};
+
+}//end of namespace
+
+#endif // FITTING_CONTEXT_H
@@ -0,0 +1,136 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <cstddef>
+
+namespace sq {
+
+///number of values per point written by the gradient of sq_batch_radial_residual
+const int SQ_KERNEL_GRAD_SIZE = 11;
+
+/**
+ * @brief Layout of the gradient written by sq_batch_radial_residual. The gradient is stored
+ * as structure of arrays, value k of point i is at grad[k * n + i]. The first eight
+ * entries are the derivatives w.r.t. a1, a2, a3, e1, e2 and the translation. The last three are
+ * (R * q) x dr/dp, the derivative of a rotation of the rotated point about the x, y, z axes.
+ */
+enum KernelGradient
+{
+  GRAD_A1 = 0, GRAD_A2, GRAD_A3, GRAD_E1, GRAD_E2,
+  GRAD_TX, GRAD_TY, GRAD_TZ,
+  GRAD_RX, GRAD_RY, GRAD_RZ
+};
+
+/**
+ * @brief Instruction sets the batch kernels can run on
+ */
+enum KernelType
+{
+  KERNEL_SCALAR = 0,
+  KERNEL_SSE2,
+  KERNEL_AVX2
+};
+
+/**
+ * @brief Accuracy of the powers |x|^p evaluated by the batch kernels. Exponents 0.5, 1 and 2
+ * are always exact, which covers ellipsoids and cylinders. Other exponents are computed as
+ * exp(p * log|x|) with
+ * - ACCURACY_FULL: the cephes log and exp, as accurate as std::pow
+ * - ACCURACY_HIGH: log2 and exp2 polynomials, relative error below 1e-8 for p <= 20
+ * - ACCURACY_FAST: shorter log2 and exp2 polynomials, relative error below 2e-4 for p <= 20
+ */
+enum KernelAccuracy
+{
+  ACCURACY_FULL = 0,
+  ACCURACY_HIGH,
+  ACCURACY_FAST
+};
+
+/**
+ * @brief superquadric shape and the rigid transformation applied to the points
+ * before the evaluation. e1 and e2 are clamped between 0.1 and 1.9 by the kernels
+ */
+struct SQKernelParam
+{
+  double a1, a2, a3, e1, e2;
+  ///3x4 row major transformation [R | t]
+  double transform[12];
+  ///accuracy of the powers, so that every fit can choose its own
+  KernelAccuracy accuracy;
+};
+
+/**
+ * @brief fills the shape of the kernel parameter, sets the transformation to identity and the
+ * accuracy to sq_kernel_accuracy()
+ */
+void sq_kernel_param(const double a1, const double a2, const double a3, const double e1, const double e2,
+                     SQKernelParam& param);
+
+/**
+ * @brief sets the transformation of the kernel parameter
+ * @param rotation 3x3 column major rotation matrix
+ * @param translation
+ */
+void sq_kernel_set_transform(const double* rotation, const double* translation, SQKernelParam& param);
+
+/**
+ * @brief evaluates the inside-outside function
+ * ((|x/a1|^(2/e2) + |y/a2|^(2/e2))^(e2/e1) + |z/a3|^(2/e1)) on n points,
+ * which is < 1 inside, 1 on the surface and > 1 outside the superquadric
+ */
+void sq_batch_inside_outside(const double* x, const double* y, const double* z, const std::size_t n,
+                             const SQKernelParam& param, double* inside_outside);
+
+void sq_batch_inside_outside(const float* x, const float* y, const float* z, const std::size_t n,
+                             const SQKernelParam& param, float* inside_outside);
+
+/**
+ * @brief evaluates the radial residual ||OP|| * (F^(e1/2) - 1) * (a1*a2*a3)^0.25 on n points
+ * @param residual n values
+ * @param grad if not NULL, SQ_KERNEL_GRAD_SIZE * n values, see KernelGradient
+ */
+void sq_batch_radial_residual(const double* x, const double* y, const double* z, const std::size_t n,
+                              const SQKernelParam& param, double* residual, double* grad = NULL);
+
+void sq_batch_radial_residual(const float* x, const float* y, const float* z, const std::size_t n,
+                              const SQKernelParam& param, float* residual, float* grad = NULL);
+
+/**
+ * @brief sum of the squared radial residuals on n points
+ */
+double sq_batch_squared_error(const double* x, const double* y, const double* z, const std::size_t n,
+                              const SQKernelParam& param);
+
+double sq_batch_squared_error(const float* x, const float* y, const float* z, const std::size_t n,
+                              const SQKernelParam& param);
+
+/**
+ * @brief obtain the instruction set used by the batch kernels, chosen at runtime
+ */
+KernelType sq_kernel_type();
+
+/**
+ * @brief force the instruction set used by the batch kernels
+ * @return false if it is not supported by this cpu
+ */
+bool sq_set_kernel_type(const KernelType type);
+
+/**
+ * @brief obtain the default accuracy of the powers, ACCURACY_FULL unless set
+ */
+KernelAccuracy sq_kernel_accuracy();
+
+/**
+ * @brief set the default accuracy of the powers, taken by the kernel parameters filled after
+ * the call and used by sq_kernel_pow. Safe to call while other threads evaluate kernels
+ */
+void sq_set_kernel_accuracy(const KernelAccuracy accuracy);
+
+/**
+ * @brief |x|^p with the accuracy of the batch kernels, 0 at x = 0
+ */
+double sq_kernel_pow(const double x, const double p);
+
+}//end of namespace
+
+#endif // KERNEL_H
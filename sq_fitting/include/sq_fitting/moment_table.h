@@ -0,0 +1,145 @@
+#ifndef MOMENT_TABLE_H
+#define MOMENT_TABLE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <sq_fitting/utils.h>
+
+namespace sq {
+
+/**
+ * @brief cheap shape statistics of a pre aligned cloud, whose axes are the principal axes
+ * by decreasing variance
+ */
+struct MomentDescriptor
+{
+  ///center of the bounding box
+  Eigen::Vector3d center;
+  ///half extents of the bounding box
+  Eigen::Vector3d half_extent;
+  ///standard deviation of the points along every axis, about the origin
+  Eigen::Vector3d deviation;
+
+  /**
+   * @brief scale invariant features in [0, 1]: the ratios of consecutive deviations and the
+   * deviation over the half extent of every axis
+   */
+  void features(double* values) const;
+};
+
+/**
+ * @brief computes the descriptor of the points in one pass
+ * @param points pre aligned points
+ * @param descriptor
+ */
+void momentDescriptor(const PointBuffer& points, MomentDescriptor& descriptor);
+
+/**
+ * @brief lookup table from the quantized features of a MomentDescriptor to the exponents and
+ * sizes of the superquadric sampled with them. The table is generated offline by
+ * moment_table_generator and saved as a compact binary file, a query is a single cell read
+ */
+class MomentTable
+{
+public:
+  enum
+  {
+    ///bins of every feature
+    BINS = 6,
+    ///features of a MomentDescriptor
+    FEATURES = 5
+  };
+
+  /**
+   * @brief superquadric of a cell, quantized to a byte per value
+   */
+  struct Entry
+  {
+    ///axis of the pre aligned points along the z axis of the superquadric
+    uint8_t axis;
+    ///e1 and e2 from 0.1 (0) to 1.9 (255)
+    uint8_t e1;
+    uint8_t e2;
+    ///size along every axis of the pre aligned points over its half extent, from 0 (0) to 2 (255)
+    uint8_t size[3];
+  };
+
+  /**
+   * @brief superquadric of a cell in parameter units
+   */
+  struct Shape
+  {
+    int axis;
+    double e1;
+    double e2;
+    ///size along every axis of the pre aligned points
+    Eigen::Vector3d size;
+  };
+
+  /**
+   * @brief Constructor of an empty table
+   */
+  MomentTable();
+
+  /**
+   * @brief reads a table saved by save()
+   * @param path
+   * @return false if the file is missing or not a table of BINS and FEATURES, the table is then empty
+   */
+  bool load(const std::string& path);
+
+  /**
+   * @brief writes the table
+   * @param path
+   * @return false if the file could not be written
+   */
+  bool save(const std::string& path) const;
+
+  /**
+   * @brief true until a table is loaded or generated
+   */
+  bool empty() const;
+
+  /**
+   * @brief number of cells, BINS^FEATURES
+   */
+  static std::size_t size();
+
+  /**
+   * @brief cell of the quantized features of a descriptor
+   */
+  static std::size_t cell(const MomentDescriptor& descriptor);
+
+  /**
+   * @brief superquadric of the cell of the descriptor, scaled by its half extents
+   * @param descriptor
+   * @param shape
+   * @return false if the table is empty
+   */
+  bool lookup(const MomentDescriptor& descriptor, Shape& shape) const;
+
+  /**
+   * @brief sets the entries of every cell, used by the generator
+   * @param entries size() entries
+   */
+  void setEntries(const std::vector<Entry>& entries);
+
+  /**
+   * @brief quantizes a shape whose sizes are relative to the half extents
+   */
+  static Entry encode(const Shape& relative);
+
+  /**
+   * @brief shape of an entry, with sizes relative to the half extents
+   */
+  static Shape decode(const Entry& entry);
+
+private:
+  std::vector<Entry> entries_;
+};
+
+}//end of namespace
+
+#endif // MOMENT_TABLE_H
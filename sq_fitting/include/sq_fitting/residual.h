@@ -0,0 +1,154 @@
+#ifndef RESIDUAL_H
+#define RESIDUAL_H
+
+#include <cmath>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <unsupported/Eigen/AutoDiff>
+
+namespace sq {
+
+///forward mode dual number with one derivative per unknown a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+typedef Eigen::AutoDiffScalar<Eigen::Matrix<double, 11, 1> > SQJet;
+
+/**
+ * @brief value of a scalar or of a dual number
+ */
+inline double sq_value(const double v)
+{
+  return v;
+}
+
+template<typename Derivative>
+inline double sq_value(const Eigen::AutoDiffScalar<Derivative>& v)
+{
+  return v.value();
+}
+
+/**
+ * @brief |v|^p, which is zero with zero derivatives at v = 0
+ */
+template<typename T>
+T sq_pow_abs(const T& v, const T& p)
+{
+  using std::abs;
+  using std::exp;
+  using std::log;
+  if(sq_value(v) == 0)
+    return T(0.);
+  return exp(p * log(abs(v)));
+}
+
+/**
+ * @brief radial residual ||OP|| * (F^(e1/2) - 1) * (a1*a2*a3)^0.25 of a point transformed by the
+ * fitting unknowns, the same residual as the batch kernels. e1 and e2 are clamped between
+ * 0.1 and 1.9. Instantiated with SQJet it gives the exact derivatives w.r.t. the unknowns
+ * @param xvec unknowns a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az, see create_transformation_matrix
+ * @param px
+ * @param py
+ * @param pz
+ * @return radial residual
+ */
+template<typename T>
+T sq_residual(const T* xvec, const double px, const double py, const double pz)
+{
+  using std::sin;
+  using std::cos;
+  using std::sqrt;
+
+  //rotation rx * rz * ry, applied to the point from the right
+  const T sx = sin(xvec[8]), cx = cos(xvec[8]);
+  const T sy = sin(xvec[9]), cy = cos(xvec[9]);
+  const T sz = sin(xvec[10]), cz = cos(xvec[10]);
+  const T x_y = cy * px + sy * pz;
+  const T z_y = cy * pz - sy * px;
+  const T x_z = cz * x_y - sz * py;
+  const T y_z = sz * x_y + cz * py;
+  const T x = x_z + xvec[5];
+  const T y = cx * y_z - sx * z_y + xvec[6];
+  const T z = sx * y_z + cx * z_y + xvec[7];
+
+  T e1 = xvec[3];
+  T e2 = xvec[4];
+  if(sq_value(e1) < 0.1)
+    e1 = T(0.1);
+  else if(sq_value(e1) > 1.9)
+    e1 = T(1.9);
+  if(sq_value(e2) < 0.1)
+    e2 = T(0.1);
+  else if(sq_value(e2) > 1.9)
+    e2 = T(1.9);
+
+  const T t1 = sq_pow_abs(T(x / xvec[0]), T(2. / e2));
+  const T t2 = sq_pow_abs(T(y / xvec[1]), T(2. / e2));
+  const T t3 = sq_pow_abs(T(z / xvec[2]), T(2. / e1));
+  const T f = sq_pow_abs(T(t1 + t2), T(e2 / e1)) + t3;
+  const T fp = sq_pow_abs(f, T(e1 / 2.));
+  const T s = sq_pow_abs(T(xvec[0] * xvec[1] * xvec[2]), T(0.25));
+  const T op2 = x * x + y * y + z * z;
+  if(sq_value(op2) == 0)
+    return T(0.);
+  return sqrt(op2) * (fp - 1.) * s;
+}
+
+/**
+ * @brief misalignment of an observed normal with the normal of the superquadric at a point,
+ * the cross product of the normalized gradient of the inside outside function at the point
+ * transformed by the fitting unknowns and the rotated normal. Its norm is the sine of the angle
+ * between them, so the orientation of the observed normal does not matter. e1 and e2 are
+ * clamped between 0.1 and 1.9
+ * @param xvec unknowns a1, a2, a3, e1, e2, tx, ty, tz, only the sizes, exponents and
+ * translation are read
+ * @param rotation rotation of the unknowns, rx * rz * ry for the euler angles
+ * @param p point
+ * @param n observed normal of unit length
+ * @param residual 3 values, zero at the center of the superquadric
+ */
+template<typename T>
+void sq_normal_residual(const T* xvec, const Eigen::Matrix<T, 3, 3>& rotation, const Eigen::Vector3d& p,
+                        const Eigen::Vector3d& n, T* residual)
+{
+  using std::sqrt;
+
+  const Eigen::Matrix<T, 3, 1> q = rotation * p.cast<T>() + Eigen::Matrix<T, 3, 1>(xvec[5], xvec[6], xvec[7]);
+  const Eigen::Matrix<T, 3, 1> m = rotation * n.cast<T>();
+
+  T e1 = xvec[3];
+  T e2 = xvec[4];
+  if(sq_value(e1) < 0.1)
+    e1 = T(0.1);
+  else if(sq_value(e1) > 1.9)
+    e1 = T(1.9);
+  if(sq_value(e2) < 0.1)
+    e2 = T(0.1);
+  else if(sq_value(e2) > 1.9)
+    e2 = T(1.9);
+
+  //gradient of the inside outside function up to the common factor 2 / e1
+  const T t1 = sq_pow_abs(T(q(0) / xvec[0]), T(2. / e2));
+  const T t2 = sq_pow_abs(T(q(1) / xvec[1]), T(2. / e2));
+  const T t12 = sq_pow_abs(T(t1 + t2), T(e2 / e1 - 1.));
+  Eigen::Matrix<T, 3, 1> g;
+  g(0) = t12 * sq_pow_abs(T(q(0) / xvec[0]), T(2. / e2 - 1.)) / xvec[0];
+  g(1) = t12 * sq_pow_abs(T(q(1) / xvec[1]), T(2. / e2 - 1.)) / xvec[1];
+  g(2) = sq_pow_abs(T(q(2) / xvec[2]), T(2. / e1 - 1.)) / xvec[2];
+  for(int k=0;k<3;++k)
+  {
+    if(sq_value(q(k)) < 0)
+      g(k) = -g(k);
+  }
+  const T norm2 = g.squaredNorm();
+  if(sq_value(norm2) == 0)
+  {
+    residual[0] = residual[1] = residual[2] = T(0.);
+    return;
+  }
+  const Eigen::Matrix<T, 3, 1> c = g.cross(m) / sqrt(norm2);
+  residual[0] = c(0);
+  residual[1] = c(1);
+  residual[2] = c(2);
+}
+
+}//end of namespace
+
+#endif // RESIDUAL_H
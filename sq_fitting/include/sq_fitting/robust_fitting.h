@@ -0,0 +1,84 @@
+#ifndef ROBUST_FITTING_H
+#define ROBUST_FITTING_H
+#include <sq_fitting/fitting.h>
+
+/**
+ * @brief class for fitting superquadric parameters on point cloud data with outliers.
+ * Superquadrics are fitted on random subsets of the pre aligned cloud, the one with most
+ * inliers is refined on its inliers only with a robust loss
+ */
+class RobustSuperquadricFitting : public SuperquadricFitting
+{
+public:
+  /**
+   * @brief Constructor initialize by point cloud data
+   * @param input_cloud
+   */
+  RobustSuperquadricFitting(const pcl::PointCloud<PointT>::Ptr& input_cloud);
+
+  /**
+   * @brief number of points of every random subset, at least the 11 unknowns
+   * @param sample_size
+   */
+  void setSampleSize(int sample_size);
+
+  /**
+   * @brief maximum number of random subsets
+   * @param max_iterations
+   */
+  void setMaxIterations(int max_iterations);
+
+  /**
+   * @brief a point is an inlier if its distance to the surface along the ray from the center
+   * of the superquadric is below threshold
+   * @param threshold in m
+   */
+  void setInlierThreshold(double threshold);
+
+  /**
+   * @brief probability of drawing at least one subset without outliers, used to stop
+   * as soon as enough subsets were drawn for the current inlier ratio
+   * @param probability
+   */
+  void setProbability(double probability);
+
+  /**
+   * @brief maximum number of refinements on the inliers, inliers are selected again after
+   * every refinement
+   * @param refinements
+   */
+  void setRefinements(int refinements);
+
+  /**
+   * @brief fit random subsets, refine the best one on its inliers and set minimum param
+   * and minimum error
+   */
+  virtual void fit();
+
+  /**
+   * @brief obtain indices of the input cloud which are inliers of the fitted superquadric
+   * @param inliers
+   */
+  void getInliers(std::vector<int>& inliers);
+
+private:
+  int sample_size_;
+  int max_iterations_;
+  double inlier_threshold_;
+  double probability_;
+  int refinements_;
+  std::vector<int> inliers_;
+
+  /**
+   * @brief counts the inliers of the points with the batched radial residual
+   * @param xvec parameters a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+   * @param threshold distance to the surface in m
+   * @param residual buffer of the size of the points
+   * @param inliers if not NULL, filled with the indices of the inliers
+   * @return number of inliers
+   */
+  int countInliers(const sq::PointBuffer& points, const Vector11d& xvec, const double threshold,
+                   std::vector<double>& residual, std::vector<int>* inliers);
+};
+
+#endif // ROBUST_FITTING_H
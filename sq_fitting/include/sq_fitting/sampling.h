@@ -16,16 +16,19 @@
 typedef pcl::PointXYZRGB PointT;
 
 /**
- * @brief Sample superquadrics based on provided parameters
+ * @brief Sample superquadrics based on provided parameters. It is instantiated for
+ * pcl::PointXYZ, pcl::PointXYZRGB and pcl::PointNormal, points with a color get the random
+ * color of the superquadric
  */
-class SuperquadricSampling
+template<typename PointType>
+class SuperquadricSamplingT
 {
 public:
   /**
    * @brief Constructor
    * @param sq_params ros msg for superquadrics
    */
-  SuperquadricSampling(const sq_fitting::sq& sq_params);
+  SuperquadricSamplingT(const sq_fitting::sq& sq_params);
 
   /**
    * @brief Sampling by superquadric equation
@@ -41,7 +44,7 @@ public:
    * @brief obtain cloud
    * @param cloud
    */
-  void getCloud(pcl::PointCloud<PointT>::Ptr& cloud);
+  void getCloud(typename pcl::PointCloud<PointType>::Ptr& cloud);
 
   /**
    * @brief obtain cloud ros
@@ -52,7 +55,7 @@ public:
 
 
 private:
-  pcl::PointCloud<PointT>::Ptr cloud_;
+  typename pcl::PointCloud<PointType>::Ptr cloud_;
   sensor_msgs::PointCloud2 cloud_ros_;
   sq_fitting::sq params_;
   float r_, g_, b_;
@@ -62,8 +65,12 @@ private:
    * @param input_cloud
    * @param output_cloud
    */
-  void transformCloud(const pcl::PointCloud<PointT>::Ptr &input_cloud, pcl::PointCloud<PointT>::Ptr& output_cloud);
+  void transformCloud(const typename pcl::PointCloud<PointType>::Ptr &input_cloud,
+                      typename pcl::PointCloud<PointType>::Ptr& output_cloud);
 
 };
 
+///sampling of the fitted superquadrics published by the node
+typedef SuperquadricSamplingT<PointT> SuperquadricSampling;
+
 #endif // SAMPLING_H
@@ -35,6 +35,8 @@ struct  Object
 {
    ///PointCloud of the object
    PointCloud obj_cloud;
+   ///normal of the supervoxel of every point of obj_cloud, NaN for unlabeled points
+   pcl::PointCloud<pcl::Normal> obj_normals;
    /// label assigned by LCCP algorithm
    int label;
 };
@@ -300,6 +302,12 @@ public:
    * @return pointcloud
    */
   CloudPtr get_plane_cloud();
+
+  /**
+   * @brief get_plane_coefficients returns the table plane model
+   * @return coefficients a, b, c, d of ax + by + cz + d = 0, empty if no plane was found
+   */
+  pcl::ModelCoefficients get_plane_coefficients();
 };
 
 
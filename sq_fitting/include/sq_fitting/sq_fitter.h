@@ -3,13 +3,17 @@
 #include <ros/ros.h>
 #include <sq_fitting/segmentation.h>
 #include <sq_fitting/fitting.h>
+#include <sq_fitting/robust_fitting.h>
 #include <sq_fitting/sampling.h>
 #include <sq_fitting/sq.h>
 #include <sq_fitting/sqArray.h>
+#include <sq_fitting/fitReportArray.h>
 #include <sq_fitting/get_sq.h>
 #include <pcl/filters/filter.h>
 #include <geometry_msgs/PoseArray.h>
 #include <visualization_msgs/Marker.h>
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <thread>
 
@@ -32,6 +36,49 @@ public:
     std::vector<double> ws_limits;
     bool remove_nan;
     std::string pose_est_method;
+    ///lm/ransac, ransac fits random subsets and refines on the inliers
+    std::string fitting_method;
+    ///double/float, float evaluates the residuals in single precision
+    std::string fitting_precision;
+    ///euler/so3, so3 steps the rotation with rotation vectors, see SuperquadricFitting::set_rotation
+    std::string fitting_rotation;
+    ///full/high/fast, accuracy of the powers of the residual kernels, see sq::KernelAccuracy
+    std::string kernel_accuracy;
+    ///restrict the shape and pose of the superquadric to a box while fitting, see SuperquadricFitting::setBounds
+    bool bounded;
+    ///none/plane/tangent, fit objects standing on the table plane found by the segmentation,
+    ///tangent also keeps their bottom on it, see SuperquadricFitting::setSupportPlane
+    std::string support_plane;
+    ///fit objects as if completed by their reflection through their center, without mirroring
+    ///their clouds, see SuperquadricFitting::setSymmetric
+    bool symmetric;
+    ///start every fit from the closest box, cylinder or ellipsoid, see SuperquadricFitting::setPrimitives
+    bool primitives;
+    ///rms distance in m under which the primitive is the fit
+    double primitive_distance;
+    ///file of the moment table generated by moment_table_generator, empty to not use one
+    std::string moment_table;
+    ///weight in m of the misalignment of the supervoxel normals of the segmentation with the
+    ///superquadric normals, <= 0 to fit the points only, see SuperquadricFitting::setNormals
+    double normal_weight;
+    ///seed the fit of every object with the superquadric of the previous frame
+    bool warm_start;
+    ///maximum distance between centroids of an object in consecutive frames
+    double warm_start_distance;
+    ///time in s to fit all objects of a frame, objects which did not converge keep their best
+    ///superquadric so far. <= 0 fits every object until it converges. Not used by ransac
+    double fit_deadline;
+  };
+
+  /**
+   * @brief superquadric fitted on a previous frame
+   */
+  struct TrackedObject
+  {
+    sq_fitting::sq param;
+    ///centroid of the object cloud
+    Eigen::Vector3d centroid;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   };
 
   /**
@@ -102,6 +149,32 @@ private:
    */
   void transformFrameCloudBack(const CloudPtr& cloud_in, CloudPtr& cloud_out);
 
+  /**
+   * @brief looks up the transform from the sensor frame to output_frame, once per frame
+   * @param transform identity if both frames are the same
+   * @return false if the transform is not available
+   */
+  bool lookupOutputTransform(Eigen::Affine3d& transform);
+
+  /**
+   * @brief transforms the coefficients of a plane from the sensor frame to output_frame
+   * @param plane_in a, b, c, d of ax + by + cz + d = 0
+   * @param transform sensor frame to output_frame, see lookupOutputTransform
+   * @param plane_out
+   * @return false if plane_in is not a plane
+   */
+  static bool transformFramePlane(const std::vector<double>& plane_in, const Eigen::Affine3d& transform,
+                                  std::vector<double>& plane_out);
+
+  /**
+   * @brief rotates normals from the sensor frame to output_frame
+   * @param normals_in
+   * @param rotation rotation of the transform from the sensor frame to output_frame
+   * @param normals_out
+   */
+  static void transformFrameNormals(const pcl::PointCloud<pcl::Normal>& normals_in, const Eigen::Matrix3f& rotation,
+                                    pcl::PointCloud<pcl::Normal>& normals_out);
+
   /**
    * @brief statistical outlier removal filter
    * @param cloud_in
@@ -117,7 +190,8 @@ private:
   void filter_RadiusOutlier(CloudPtr& cloud_in, CloudPtr& cloud_out);
 
   /**
-   * @brief mirrors the cloud
+   * @brief mirrors the cloud, doubling its points. Parameters::symmetric fits the same
+   * completion without the mirrored points
    * @param cloud_in
    * @param cloud_out
    */
@@ -128,9 +202,68 @@ private:
    * vector
    * @param cloud_in individual object cloud
    * @param method pca/iteration
+   * @param guess initial guess of the fitting, NULL to fit from the pre aligned cloud
+   * @param normals normals of the object cloud, NULL to fit the points only
+   * @param context workspaces of the fitting
+   * @param fitted_param fitted superquadric of the object
+   * @param report statistics of the fit of the object
+   * @param pvector
+   */
+  void fitAndSampleTh(CloudPtr &cloud_in,std::string& method, const sq_fitting::sq* guess,
+                      const pcl::PointCloud<pcl::Normal>::ConstPtr& normals, sq::FittingContext* context,
+                      sq_fitting::sq& fitted_param, sq_fitting::fitReport& report, ParamMultiVector& pvector);
+
+  /**
+   * @brief creates the fitting of an object with the fitting parameters
+   * @param cloud_in individual object cloud
+   * @param method pca/iteration
+   * @param guess initial guess of the fitting, NULL to fit from the pre aligned cloud
+   * @param normals normals of the object cloud, NULL to fit the points only
+   * @param context workspaces of the fitting, see SuperquadricFitting::setContext
+   * @param fit
+   */
+  void createFitting(CloudPtr &cloud_in, const std::string& method, const sq_fitting::sq* guess,
+                     const pcl::PointCloud<pcl::Normal>::ConstPtr& normals, sq::FittingContext* context,
+                     std::unique_ptr<SuperquadricFitting>& fit);
+
+  /**
+   * @brief converts the report of a fitting to a message
+   * @param fit
+   * @param param fitted superquadric
+   * @param report
+   */
+  void fillReport(SuperquadricFitting& fit, const sq_fitting::sq& param, sq_fitting::fitReport& report);
+
+  /**
+   * @brief threaded function to sample a superquadric and store it in a vector
+   * @param param
    * @param pvector
    */
-  void fitAndSampleTh(CloudPtr &cloud_in,std::string& method, ParamMultiVector& pvector);
+  void sampleTh(const sq_fitting::sq& param, ParamMultiVector& pvector);
+
+  /**
+   * @brief fits all objects with resumable fits, interleaving a few iterations of every
+   * unfinished object on the thread pool until all converged or the deadline passed. The
+   * deadline is checked before every iteration, but the pre alignment and start of every
+   * object, a few passes over its points, always run. The fits are in double precision
+   * @param objs segmented objects
+   * @param guesses initial guess of every object, NULL to fit from the pre aligned cloud
+   * @param normals normals of every object, NULL to fit the points only
+   * @param deadline
+   * @param fitted_params fitted superquadric of every object, the best so far if it did not converge
+   */
+  void fitScheduled(std::vector<CloudPtr>& objs, const std::vector<const sq_fitting::sq*>& guesses,
+                    const std::vector<pcl::PointCloud<pcl::Normal>::ConstPtr>& normals,
+                    const std::chrono::steady_clock::time_point& deadline,
+                    std::vector<sq_fitting::sq>& fitted_params);
+
+  /**
+   * @brief associates every object with the closest tracked object of the previous frame
+   * @param centroids centroid of every object cloud
+   * @param guesses superquadric of the associated tracked object, NULL if there is none
+   */
+  void associateObjects(const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& centroids,
+                        std::vector<const sq_fitting::sq*>& guesses);
 
   /**
    * @brief function to fit and sample segmented objects
@@ -156,6 +289,10 @@ private:
   //ROS clouds for visualization
   ///table cloud
   sensor_msgs::PointCloud2 table_cloud_;
+  ///table plane coefficients in output frame, empty if the segmentation found no plane
+  std::vector<double> table_plane_;
+  ///moment table shared by all fits, see SuperquadricFitting::setMomentTable
+  sq::MomentTable moment_table_;
   ///objects cloud
   sensor_msgs::PointCloud2 objects_cloud_ros_;
   ///superquadrics clouds
@@ -190,10 +327,14 @@ private:
   ros::Publisher poses_pub_;
   ///mirrored cloud publisher
   ros::Publisher cut_cloud_pub_;
+  ///fit statistics publisher
+  ros::Publisher fit_reports_pub_;
 
   //Internal containers
   ///Vector to store segmented object clouds
   std::vector<CloudPtr> Objects_;
+  ///supervoxel normals of every object in Objects_, in output frame
+  std::vector<pcl::PointCloud<pcl::Normal>::Ptr> object_normals_;
   ///multivector to store mapping between SQ param and cloudPtr
   ParamMultiVector pVector_;
   ///Array of SQ poses
@@ -202,6 +343,13 @@ private:
   SQFitter::Parameters sq_param_;
   ///container for superquadrics params
   sq_fitting::sqArray sqArr_;
+  ///statistics of the fits of the last frame
+  sq_fitting::fitReportArray fit_reports_;
+  ///superquadrics of the previous frame
+  std::vector<TrackedObject, Eigen::aligned_allocator<TrackedObject> > tracked_objects_;
+  ///workspaces of the fitting of object i, kept across frames so that fitting does not allocate
+  ///once they have grown to the objects of the scene
+  std::vector<std::unique_ptr<sq::FittingContext> > contexts_;
 
   ///Node running
   bool initialized;
@@ -0,0 +1,115 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sq {
+
+/**
+ * @brief fixed set of worker threads running batches of indexed tasks. The thread calling
+ * run() works on its own batch as well, so run() can be called from inside a task without
+ * waiting on a busy pool
+ */
+class ThreadPool
+{
+public:
+  /**
+   * @brief Constructor
+   * @param n_workers number of worker threads besides the calling thread
+   */
+  explicit ThreadPool(const unsigned n_workers);
+
+  ~ThreadPool();
+
+  /**
+   * @brief pool shared by the library, with one worker less than the hardware threads
+   */
+  static ThreadPool& instance();
+
+  /**
+   * @brief runs task(i) for i in [0, n) and returns when all of them are finished
+   */
+  void run(const std::size_t n, const std::function<void(std::size_t)>& task);
+
+  /**
+   * @brief splits [0, n) into chunks of chunk_size and runs task(chunk, begin, end) for each of
+   * them, on the pool if n is at least parallel_threshold and on the calling thread otherwise.
+   * The chunks do not depend on the number of threads, so reducing results of the chunks in
+   * chunk order is deterministic. The task is not copied into a std::function, so that running
+   * it does not allocate
+   */
+  template<typename Task>
+  void runChunks(const std::size_t n, const std::size_t chunk_size, const std::size_t parallel_threshold,
+                 const Task& task)
+  {
+    const std::size_t n_chunks = chunkCount(n, chunk_size);
+    if(n < parallel_threshold || n_chunks == 1)
+    {
+      for(std::size_t i=0;i<n_chunks;++i)
+        task(i, std::min(n, i * chunk_size), std::min(n, (i + 1) * chunk_size));
+      return;
+    }
+    const auto chunk_task = [&](std::size_t i)
+    {
+      task(i, std::min(n, i * chunk_size), std::min(n, (i + 1) * chunk_size));
+    };
+    //wrapped by reference, so that std::function does not copy the task to the heap
+    run(n_chunks, std::cref(chunk_task));
+  }
+
+  /**
+   * @brief number of chunks of runChunks(), at least one so that reductions have a result
+   */
+  static std::size_t chunkCount(const std::size_t n, const std::size_t chunk_size);
+
+  /**
+   * @brief number of threads working on a batch, including the calling thread
+   */
+  unsigned size() const;
+
+private:
+  /**
+   * @brief indexed tasks of one call to run()
+   */
+  struct Batch
+  {
+    const std::function<void(std::size_t)>* task;
+    std::size_t n;
+    ///next index to run
+    std::atomic<std::size_t> next;
+    ///number of finished indices
+    std::atomic<std::size_t> done;
+    ///number of workers holding the batch
+    std::atomic<int> users;
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator = (const ThreadPool&);
+
+  /**
+   * @brief runs indices of the batch until none is left
+   */
+  void runBatch(Batch& batch);
+
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<Batch*> batches_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+};
+
+}//end of namespace
+
+#endif // THREAD_POOL_H
@@ -14,14 +14,150 @@
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/surface/mls.h>
 #include "sq_fitting/sq.h"
+#include "sq_fitting/kernel.h"
 
 #include <pcl/surface/convex_hull.h>
 
 
+///point type of the segmented clouds, the fitting and the sampling are also instantiated for
+///pcl::PointXYZ and pcl::PointNormal
 typedef pcl::PointXYZRGB PointT;
 
 namespace sq {
 
+/**
+ * @brief structure of arrays buffer of xyz coordinates, the layout used by the batch kernels
+ */
+template<typename Scalar>
+struct PointBufferT
+{
+  std::vector<Scalar> x;
+  std::vector<Scalar> y;
+  std::vector<Scalar> z;
+  size_t size() const {return x.size();}
+};
+
+typedef PointBufferT<double> PointBuffer;
+///single precision buffer for the float batch kernels
+typedef PointBufferT<float> PointBufferf;
+
+///points per chunk of the parallel loops over a PointBuffer, fixed so that reductions do not
+///depend on the number of threads
+const size_t SQ_POINT_CHUNK_SIZE = 4096;
+
+///buffers with fewer points are evaluated on the calling thread
+const size_t SQ_PARALLEL_POINTS = 16384;
+
+/**
+ * @brief copies the transformed cloud into the buffer, reusing the buffer memory
+ * @param cloud input cloud
+ * @param transform transformation applied to every point
+ * @param buffer output buffer
+ */
+template<typename PointType>
+void cloudToBuffer(const pcl::PointCloud<PointType>& cloud, const Eigen::Affine3d& transform, PointBuffer& buffer);
+
+/**
+ * @brief rounds the buffer to single precision, reusing the memory of points_f
+ */
+void bufferToFloat(const PointBuffer& points, PointBufferf& points_f);
+
+/**
+ * @brief voxel grid downsampling keeping the first point of each voxel. The leaf size is
+ * grown until at most max_points voxels are occupied. Non finite points are dropped, and
+ * points all at the same position give their first one. Buffers of at most max_points are
+ * copied as they are
+ * @param points input buffer
+ * @param max_points maximum number of points of the output, at least 1
+ * @param downsampled output buffer
+ */
+void downsampleBuffer(const PointBuffer& points, const size_t max_points, PointBuffer& downsampled);
+
+/**
+ * @brief downsampleBuffer keeping the normals of the kept points
+ * @param normals normals of the points, in the same order. NULL or empty without normals
+ * @param downsampled_normals normals of the output points, emptied without normals
+ */
+void downsampleBuffer(const PointBuffer& points, const PointBuffer* normals, const size_t max_points,
+                      PointBuffer& downsampled, PointBuffer* downsampled_normals);
+
+/**
+ * @brief first and second order statistics and bounding box of a cloud, see cloudStatistics
+ */
+struct CloudStatistics
+{
+  size_t n;
+  Eigen::Vector3d centroid;
+  ///covariance about the centroid, normalized by n
+  Eigen::Matrix3d covariance;
+  ///corners of the axis aligned bounding box
+  Eigen::Vector3d min;
+  Eigen::Vector3d max;
+
+  ///center of the bounding box, the center of sq::getCenter
+  Eigen::Vector3d center() const {return 0.5 * (max + min);}
+  ///half extents of the bounding box
+  Eigen::Vector3d halfExtent() const {return 0.5 * (max - min);}
+};
+
+/**
+ * @brief computes the centroid, covariance and bounding box of a cloud in a single pass.
+ * Blocks of points are gathered into arrays and reduced in cache, chunks of points are reduced
+ * concurrently above SQ_PARALLEL_POINTS and summed in chunk order
+ * @param cloud
+ * @param statistics
+ */
+template<typename PointType>
+void cloudStatistics(const pcl::PointCloud<PointType>& cloud, CloudStatistics& statistics);
+
+/**
+ * @brief eigen decomposition of a symmetric 3x3 matrix in closed form
+ * @param matrix
+ * @param values eigen values in decreasing order
+ * @param vectors unit eigen vectors as columns, in the order of the values, forming a right
+ * handed rotation
+ */
+void principalAxes(const Eigen::Matrix3d& matrix, Eigen::Vector3d& values, Eigen::Matrix3d& vectors);
+
+///plain array of 2D points, the input of convexHull2d
+typedef std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > Points2d;
+
+/**
+ * @brief rectangle enclosing 2D points, see minAreaRectangle
+ */
+struct Rectangle2d
+{
+  Eigen::Vector2d center;
+  ///unit direction of the first side, the second side is axis rotated by 90 degrees
+  Eigen::Vector2d axis;
+  ///half lengths of the first and second side
+  Eigen::Vector2d half_extent;
+
+  double area() const {return 4. * half_extent(0) * half_extent(1);}
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief convex hull of 2D points by the monotone chain algorithm in O(n log n), without
+ * collinear vertices. The points inside the octagon of the extreme points are dropped before
+ * sorting, which leaves few points to sort for dense clouds
+ * @param points input points, reduced, sorted and deduplicated in place
+ * @param hull vertices in counter clockwise order, reusing the memory of hull
+ */
+void convexHull2d(Points2d& points, Points2d& hull);
+
+/**
+ * @brief minimum area rectangle enclosing a convex polygon by rotating calipers. One side of the
+ * rectangle lies on an edge of the polygon, and the calipers on the three other sides only move
+ * forward, so all the edges are tried in time linear in the vertices
+ * @param hull vertices in counter clockwise order, as given by convexHull2d
+ * @param rectangle minimum area rectangle. A single vertex gives an empty rectangle, two
+ * vertices a rectangle of zero width along the segment
+ * @return false if hull is empty
+ */
+bool minAreaRectangle(const Points2d& hull, Rectangle2d& rectangle);
+
 
 /**
  * @brief clamp e1 and e1 parameter between 0.1 and 1.9
@@ -34,7 +170,8 @@ void sq_clampParameters(double& e1_clamped, double& e2_clamped);
  * @param param superquadrics parameter
  * @return distance between this superquadric and the point
  */
-double sq_function(const PointT& point, const sq_fitting::sq& param);
+template<typename PointType>
+double sq_function(const PointType& point, const sq_fitting::sq& param);
 
   /**
  * @brief calculates distance between superquadric and pcl point
@@ -43,13 +180,40 @@ double sq_function(const PointT& point, const sq_fitting::sq& param);
 double sq_function(const double &x, const double &y, const double &z, const double &a, const double &b, const double &c, const double &e1,
                    const double &e2);
 
-double sq_function_scale_weighting(const PointT& point, const sq_fitting::sq &param);
+template<typename PointType>
+double sq_function_scale_weighting(const PointType& point, const sq_fitting::sq &param);
 
-double sq_error(const pcl::PointCloud<PointT>::Ptr cloud, const sq_fitting::sq& param);
+/**
+ * @brief calculates the radial residual ||OP|| * sq_function and its closed form
+ * partial derivatives. e1 and e2 are clamped as in sq_function, so their derivatives
+ * are zero outside [0.1, 1.9]
+ * @param grad_point if not NULL, derivatives w.r.t. x, y, z (3 values)
+ * @param grad_shape if not NULL, derivatives w.r.t. a, b, c, e1, e2 (5 values)
+ * @return radial residual of the point
+ */
+double sq_radial_residual(const double &x, const double &y, const double &z, const double &a, const double &b, const double &c,
+                          const double &e1, const double &e2, double* grad_point, double* grad_shape);
+
+template<typename PointType>
+double sq_error(const pcl::PointCloud<PointType>& cloud, const sq_fitting::sq& param);
+
+/**
+ * @brief mean squared radial residual of the points, transformed by the pose of param
+ * without copying them. Chunks of large buffers are summed concurrently on sq::ThreadPool
+ */
+double sq_error(const PointBuffer& points, const sq_fitting::sq& param);
+
+/**
+ * @brief mean squared radial residual of the points which stops summing once the error
+ * reaches abandon_error
+ * @return the error, or a value not smaller than abandon_error if abandoned
+ */
+double sq_error(const PointBuffer& points, const sq_fitting::sq& param, const double abandon_error);
 
 void sq_create_transform(const geometry_msgs::Pose& pose, Eigen::Affine3f& transform);
 
-double sq_normPoint(const PointT& point);
+template<typename PointType>
+double sq_normPoint(const PointType& point);
 
 void euler2Quaternion (const double roll, const double pitch, const double yaw, Eigen::Quaterniond& q);
 
@@ -57,6 +221,14 @@ void create_transformation_matrix(const double tx, const double ty, const double
 
 void create_rotation_matrix(const double ax, const double ay, const double az, Eigen::Affine3d &rot_matrix);
 
+/**
+ * @brief kernel parameter from the fitting unknowns a1, a2, a3, e1, e2, tx, ty, tz, ax, ay, az
+ */
+void create_kernel_param(const Eigen::Ref<const Eigen::VectorXd>& xvec, SQKernelParam& param);
+
+/**
+ * @brief translation and rotation angles of a pose, the inverse of create_transformation_matrix
+ */
 void getParamFromPose(const geometry_msgs::Pose& pose, double& tx, double& ty, double& tz, double& ax, double& ay, double& az );
 
 void getParamFromPose(const Eigen::Affine3d &trans, double &tx, double &ty, double &tz, double &ax, double &ay, double &az);
@@ -65,11 +237,22 @@ void Quaternion2Euler(const geometry_msgs::Pose& pose, double& ax, double& ay, d
 
 //void cutCloud(const pcl::PointCloud<PointT>::Ptr& input_cloud, pcl::PointCloud<PointT>::Ptr& output_cloud);
 
-void getCenter(pcl::PointCloud<PointT>::Ptr& cloud_in, double& x, double& y, double& z);
+template<typename PointType>
+void getCenter(const pcl::PointCloud<PointType>& cloud_in, double& x, double& y, double& z);
 
-void getTransformPose(pcl::PointCloud<PointT>::Ptr& cloud_in, geometry_msgs::Pose& pose);
+/**
+ * @brief pose of the box of minimum volume standing on the xy plane which encloses the cloud.
+ * The x axis of the pose is along the side of the box which lies on an edge of the hull of the
+ * cloud projected on the xy plane
+ */
+template<typename PointType>
+void getTransformPose(const pcl::PointCloud<PointType>& cloud_in, geometry_msgs::Pose& pose);
 
-void getCompletePose(pcl::PointCloud<PointT>::Ptr& cloud_in, geometry_msgs::Pose &pose);
+/**
+ * @brief as getTransformPose, for the box standing on the yz plane
+ */
+template<typename PointType>
+void getCompletePose(const pcl::PointCloud<PointType>& cloud_in, geometry_msgs::Pose &pose);
 
 }//end of namespace
 
@@ -0,0 +1,158 @@
+#include<iostream>
+#include<sq_fitting/fitting.h>
+#include<sq_fitting/moment_table.h>
+#include<sq_fitting/sampling.h>
+#include<sq_fitting/sq.h>
+#include<sq_fitting/thread_pool.h>
+
+#include <pcl/point_types.h>
+#include<algorithm>
+#include<cmath>
+#include<limits>
+#include<memory>
+#include<mutex>
+
+//Generates the moment table: superquadrics over the grid of exponents and sizes are sampled,
+//pre aligned as by SuperquadricFitting, and every cell of the table keeps the mean shape of the
+//samples falling in it. Empty cells take the shape of the closest filled cell.
+//usage: moment_table_generator <output file>
+
+/**
+ * @brief shape samples of a cell
+ */
+struct CellSum
+{
+  int count;
+  double e1;
+  double e2;
+  Eigen::Vector3d size;
+  int axis_votes[3];
+
+  CellSum() : count(0), e1(0), e2(0), size(Eigen::Vector3d::Zero())
+  {
+    axis_votes[0] = axis_votes[1] = axis_votes[2] = 0;
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+  {
+    std::cout<<"usage: moment_table_generator <output file>"<<std::endl;
+    return 1;
+  }
+  const double exponents[] = {0.1, 0.25, 0.4, 0.55, 0.7, 0.85, 1.0, 1.15, 1.3, 1.45, 1.6, 1.75, 1.9};
+  //the descriptor is scale invariant, only the ratios of the sizes matter
+  const double sizes[] = {0.04, 0.07, 0.12};
+  const int n_exponents = sizeof(exponents) / sizeof(exponents[0]);
+  const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+  //the descriptor only needs a fraction of the dense samples
+  const size_t stride = 10;
+
+  std::vector<CellSum> cells(sq::MomentTable::size());
+  std::mutex cells_mutex;
+  sq::ThreadPool::instance().run(n_exponents * n_exponents, [&](std::size_t e)
+  {
+    const int i = e / n_exponents;
+    const int j = e % n_exponents;
+    for(int s=0;s<n_sizes*n_sizes*n_sizes;++s)
+    {
+      sq_fitting::sq super;
+      super.a1 = sizes[s % n_sizes];
+      super.a2 = sizes[(s / n_sizes) % n_sizes];
+      super.a3 = sizes[s / (n_sizes * n_sizes)];
+      super.e1 = exponents[i];
+      super.e2 = exponents[j];
+      super.pose.orientation.w = 1.0;
+      pcl::PointCloud<PointT>::Ptr dense(new pcl::PointCloud<PointT>);
+      std::unique_ptr<SuperquadricSampling> samp(new SuperquadricSampling(super));
+      samp->sample_pilu_fisher();
+      samp->getCloud(dense);
+      pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+      for(size_t k=0;k<dense->points.size();k+=stride)
+        cloud->points.push_back(dense->points[k]);
+      cloud->width = cloud->points.size();
+      cloud->height = 1;
+
+      SuperquadricFitting fit(cloud);
+      fit.set_pose_est_method("pca");
+      fit.setPreAlign(true, 0);
+      Eigen::Affine3f transform;
+      Eigen::Vector3f variances;
+      fit.preAlign(transform, variances);
+      sq::PointBuffer points;
+      sq::cloudToBuffer(*cloud, transform.cast<double>(), points);
+      sq::MomentDescriptor descriptor;
+      sq::momentDescriptor(points, descriptor);
+
+      //the cloud is in the frame of the superquadric, row k of the rotation is pre aligned axis k
+      const Eigen::Matrix3d rotation = transform.linear().cast<double>();
+      const double a[3] = {super.a1, super.a2, super.a3};
+      std::lock_guard<std::mutex> lock(cells_mutex);
+      CellSum& cell = cells[sq::MomentTable::cell(descriptor)];
+      int axis;
+      rotation.col(2).cwiseAbs().maxCoeff(&axis);
+      ++cell.axis_votes[axis];
+      for(int k=0;k<3;++k)
+      {
+        int m;
+        rotation.row(k).cwiseAbs().maxCoeff(&m);
+        cell.size(k) += a[m] / std::max(descriptor.half_extent(k), 1e-6);
+      }
+      cell.e1 += super.e1;
+      cell.e2 += super.e2;
+      ++cell.count;
+    }
+    if(j == n_exponents - 1)
+      std::cout<<"Sampled e1 = "<<exponents[i]<<std::endl;
+  });
+
+  //cell coordinates, to fill the empty cells with the closest filled one
+  std::vector<int> filled;
+  std::vector<Eigen::Matrix<int, sq::MomentTable::FEATURES, 1> > coordinates(cells.size());
+  for(size_t c=0;c<cells.size();++c)
+  {
+    size_t index = c;
+    for(int k=sq::MomentTable::FEATURES-1;k>=0;--k)
+    {
+      coordinates[c](k) = index % sq::MomentTable::BINS;
+      index /= sq::MomentTable::BINS;
+    }
+    if(cells[c].count > 0)
+      filled.push_back(c);
+  }
+  std::vector<sq::MomentTable::Entry> entries(cells.size());
+  for(size_t c=0;c<cells.size();++c)
+  {
+    int source = c;
+    if(cells[c].count == 0)
+    {
+      int min_distance = std::numeric_limits<int>::max();
+      for(size_t f=0;f<filled.size();++f)
+      {
+        const int distance = (coordinates[filled[f]] - coordinates[c]).squaredNorm();
+        if(distance < min_distance)
+        {
+          min_distance = distance;
+          source = filled[f];
+        }
+      }
+    }
+    const CellSum& cell = cells[source];
+    sq::MomentTable::Shape shape;
+    shape.e1 = cell.e1 / cell.count;
+    shape.e2 = cell.e2 / cell.count;
+    shape.size = cell.size / cell.count;
+    shape.axis = std::max_element(cell.axis_votes, cell.axis_votes + 3) - cell.axis_votes;
+    entries[c] = sq::MomentTable::encode(shape);
+  }
+  sq::MomentTable table;
+  table.setEntries(entries);
+  if(!table.save(argv[1]))
+  {
+    std::cout<<"Could not write "<<argv[1]<<std::endl;
+    return 1;
+  }
+  std::cout<<"Saved "<<entries.size()<<" cells, "<<filled.size()<<" filled, to "<<argv[1]<<std::endl;
+  return 0;
+}
@@ -17,6 +17,20 @@ int main(int argc, char **argv)
   nh_.getParam("workspace", params.ws_limits);
   nh_.getParam("pose_est_method", params.pose_est_method);
   nh_.getParam("remove_nan", params.remove_nan);
+  nh_.param<std::string>("fitting_method", params.fitting_method, "lm");
+  nh_.param<std::string>("fitting_precision", params.fitting_precision, "double");
+  nh_.param<std::string>("fitting_rotation", params.fitting_rotation, "euler");
+  nh_.param<std::string>("kernel_accuracy", params.kernel_accuracy, "full");
+  nh_.param<bool>("bounded", params.bounded, false);
+  nh_.param<std::string>("support_plane", params.support_plane, "none");
+  nh_.param<bool>("symmetric", params.symmetric, false);
+  nh_.param<bool>("primitives", params.primitives, false);
+  nh_.param<double>("primitive_distance", params.primitive_distance, 0.002);
+  nh_.param<std::string>("moment_table", params.moment_table, "");
+  nh_.param<double>("normal_weight", params.normal_weight, 0.);
+  nh_.param<bool>("warm_start", params.warm_start, false);
+  nh_.param<double>("warm_start_distance", params.warm_start_distance, 0.05);
+  nh_.param<double>("fit_deadline", params.fit_deadline, 0.);
   nh_.getParam("segmentation_service", segmentation_service);
 
   SQFitter sqfit(nh_, segmentation_service, cloud_topic, output_frame, params);
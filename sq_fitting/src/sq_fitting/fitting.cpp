@@ -10,47 +10,154 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <tf_conversions/tf_eigen.h>
 #include <tf/transform_listener.h>
+#include <sq_fitting/thread_pool.h>
+#include <sq_fitting/residual.h>
+#include <atomic>
+#include <chrono>
 
 
 
-SuperquadricFitting::SuperquadricFitting(const pcl::PointCloud<PointT>::Ptr& input_cloud) : pre_align_(true), pre_align_axis_(2)
+template<typename PointType>
+SuperquadricFittingT<PointType>::SuperquadricFittingT(const typename pcl::PointCloud<PointType>::Ptr& input_cloud) : pre_align_(true), pre_align_axis_(2)
 {
   cloud_ = input_cloud;
+  prealign_transform_ = Eigen::Affine3f::Identity();
   set_method_ = false;
+  jacobian_method_ = JACOBIAN_ANALYTIC;
+  multi_start_ = false;
+  multi_start_rotated_ = false;
+  has_initial_guess_ = false;
+  loss_ = LOSS_SQUARED;
+  loss_scale_ = 0;
+  normal_solver_ = true;
+  float_precision_ = false;
+  so3_rotation_ = false;
+  kernel_accuracy_ = sq::sq_kernel_accuracy();
+  parallel_threshold_ = sq::SQ_PARALLEL_POINTS;
+  bounded_ = false;
+  min_size_ = 0.005;
+  max_size_ = 0.;
+  has_support_plane_ = false;
+  support_plane_ = Eigen::Vector4d::Zero();
+  support_tangent_ = false;
+  symmetric_ = false;
+  primitives_ = false;
+  primitive_distance_ = 0.002;
+  moment_table_ = NULL;
+  normal_weight_ = 0;
+  has_statistics_ = false;
+  min_error_ = std::numeric_limits<double>::max();
+  step_.started = false;
+  step_.finished = true;
+  step_.points = NULL;
+  step_.normals = NULL;
+  context_ = &own_context_;
 }
 
-void SuperquadricFitting::getMinParams(sq_fitting::sq &param)
+template<typename PointType>
+SuperquadricFittingT<PointType>::~SuperquadricFittingT()
+{
+  exchangeBuffers();
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setContext(sq::FittingContext *context)
+{
+  exchangeBuffers();
+  context_ = context ? context : &own_context_;
+  exchangeBuffers();
+  step_.started = false;
+  step_.finished = true;
+  step_.points = NULL;
+  step_.normals = NULL;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::exchangeBuffers()
+{
+  prealigned_points_.x.swap(context_->prealigned_points.x);
+  prealigned_points_.y.swap(context_->prealigned_points.y);
+  prealigned_points_.z.swap(context_->prealigned_points.z);
+  prealigned_normals_.x.swap(context_->prealigned_normals.x);
+  prealigned_normals_.y.swap(context_->prealigned_normals.y);
+  prealigned_normals_.z.swap(context_->prealigned_normals.z);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::FitReport::add(const FitReport &other)
+{
+  iterations += other.iterations;
+  function_evaluations += other.function_evaluations;
+  jacobian_evaluations += other.jacobian_evaluations;
+  prealign_time += other.prealign_time;
+  lm_time += other.lm_time;
+  error_time += other.error_time;
+  primitive_time += other.primitive_time;
+}
+
+/**
+ * @brief wall time in s since start
+ */
+static double elapsed(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::getMinParams(sq_fitting::sq &param)
 {
   param = params_;
 }
 
-void SuperquadricFitting::getPreAlignedCloud(pcl::PointCloud<PointT>::Ptr& cloud)
+template<typename PointType>
+void SuperquadricFittingT<PointType>::getPreAlignedCloud(typename pcl::PointCloud<PointType>::Ptr& cloud)
 {
-  cloud = prealigned_cloud_;
+  cloud.reset(new pcl::PointCloud<PointType>);
+  pcl::transformPointCloud(*cloud_, *cloud, prealign_transform_);
 }
 
-void SuperquadricFitting::setPreAlign(bool pre_align, int pre_align_axis)
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setPreAlign(bool pre_align, int pre_align_axis)
 {
   pre_align_ = pre_align;
   pre_align_axis_ = pre_align_axis;
 }
 
-void SuperquadricFitting::preAlign(Eigen::Affine3f &transform, Eigen::Vector3f &variances)
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setMultiStart(bool multi_start, bool rotated)
+{
+  multi_start_ = multi_start;
+  multi_start_rotated_ = rotated;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setInitialGuess(const sq_fitting::sq &guess)
+{
+  initial_guess_ = guess;
+  has_initial_guess_ = true;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setPyramid(const std::vector<int> &point_budgets)
+{
+  pyramid_budgets_ = point_budgets;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::preAlign(Eigen::Affine3f &transform, Eigen::Vector3f &variances)
 {
   if(set_method_)
   {
     if(pose_est_method_=="iteration")
     {
         //centroid::my method
-      double x, y, z;
-      sq::getCenter(cloud_, x, y,z);
       Eigen::Affine3f transformation_centroid = Eigen::Affine3f::Identity();
-      transformation_centroid.translation()<<-x, -y, -z;
+      transformation_centroid.translation() = -statistics().center().template cast<float>();
 
       //Pose estimation
       //my method
       geometry_msgs::Pose pose;
-      sq::getTransformPose(cloud_, pose);
+      sq::getTransformPose(*cloud_, pose);
       pose.position.x = 0;
       pose.position.y = 0;
       pose.position.z = 0;
@@ -68,15 +175,16 @@ void SuperquadricFitting::preAlign(Eigen::Affine3f &transform, Eigen::Vector3f &
   //////////////////////////////////////////////////////////////////////////////////
     if(pose_est_method_=="pca")
     {
-      Eigen::Vector4f xyz_centroid;
-        pcl::compute3DCentroid(*cloud_, xyz_centroid);
+        //centroid and covariance of the single pass statistics
+        const sq::CloudStatistics& cloud_statistics = statistics();
         Eigen::Affine3f transformation_centroid = Eigen::Affine3f::Identity();
-        transformation_centroid.translation()<<-xyz_centroid(0), -xyz_centroid(1), -xyz_centroid(2);
+        transformation_centroid.translation() = -cloud_statistics.centroid.cast<float>();
         //Compute PCA
-        pcl::PCA<PointT> pca;
-        pca.setInputCloud(cloud_);
-        Eigen::Vector3f eigenValues = pca.getEigenValues();
-        Eigen::Matrix3f eigenVectors = pca.getEigenVectors();
+        Eigen::Vector3d values;
+        Eigen::Matrix3d vectors;
+        sq::principalAxes(cloud_statistics.covariance, values, vectors);
+        Eigen::Vector3f eigenValues = values.cwiseMax(0.).cast<float>();
+        Eigen::Matrix3f eigenVectors = vectors.cast<float>();
 
         //std::cout<<"Eigen value from pca: "<<eigenValues<<std::endl;
 
@@ -84,6 +192,8 @@ void SuperquadricFitting::preAlign(Eigen::Affine3f &transform, Eigen::Vector3f &
         Eigen::Vector3f vec_aux = eigenVectors.col(0);
         eigenVectors.col(0) = eigenVectors.col(pre_align_axis_);
         eigenVectors.col(pre_align_axis_) = vec_aux;
+        //keep the rotation right handed, so that the pose orientation is valid
+        eigenVectors.col(2) = eigenVectors.col(0).cross(eigenVectors.col(1));
 
         float aux_ev = eigenValues(0);
         eigenValues(0) = eigenValues(pre_align_axis_);
@@ -104,8 +214,7 @@ void SuperquadricFitting::preAlign(Eigen::Affine3f &transform, Eigen::Vector3f &
         transform = transformation_pca_affine * transformation_centroid;
         //transform = transformation_centroid*transformation_pca_affine ;
 
-        //Eigen::Vector3f eigenValues;
-        eigenValues /= static_cast<float>(cloud_->size());
+        //the covariance is already normalized by the number of points
         variances(0) = sqrt(eigenValues(0));
         variances(1) = sqrt(eigenValues(1));
         variances(2) = sqrt(eigenValues(2));
@@ -148,7 +257,8 @@ void SuperquadricFitting::preAlign(Eigen::Affine3f &transform, Eigen::Vector3f &
 
 }
 
-bool SuperquadricFitting::set_pose_est_method(const std::string method)
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_pose_est_method(const std::string method)
 {
   if(method == "pca" || method== "iteration")
   {
@@ -160,42 +270,383 @@ bool SuperquadricFitting::set_pose_est_method(const std::string method)
     return false;
 }
 
-void SuperquadricFitting::fit_Param(sq_fitting::sq& param, double& final_error)
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_jacobian_method(const std::string method)
 {
-  Eigen::Affine3f transform_inv;
-  Eigen::Vector3f variances;
-  if(pre_align_)
+  if(method == "analytic")
+    jacobian_method_ = JACOBIAN_ANALYTIC;
+  else if(method == "autodiff")
+    jacobian_method_ = JACOBIAN_AUTODIFF;
+  else if(method == "numerical")
+    jacobian_method_ = JACOBIAN_NUMERICAL;
+  else
+    return false;
+  return true;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_loss(const std::string loss)
+{
+  if(loss == "squared")
+    loss_ = LOSS_SQUARED;
+  else if(loss == "huber")
+    loss_ = LOSS_HUBER;
+  else if(loss == "cauchy")
+    loss_ = LOSS_CAUCHY;
+  else
+    return false;
+  return true;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_solver(const std::string solver)
+{
+  if(solver == "qr" || solver == "normal")
   {
+    normal_solver_ = solver == "normal";
+    return true;
+  }
+  else
+    return false;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_precision(const std::string precision)
+{
+  if(precision == "double" || precision == "float")
+  {
+    float_precision_ = precision == "float";
+    return true;
+  }
+  else
+    return false;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_rotation(const std::string rotation)
+{
+  if(rotation == "euler" || rotation == "so3")
+  {
+    so3_rotation_ = rotation == "so3";
+    return true;
+  }
+  else
+    return false;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::set_kernel_accuracy(const std::string accuracy)
+{
+  if(accuracy == "full")
+    kernel_accuracy_ = sq::ACCURACY_FULL;
+  else if(accuracy == "high")
+    kernel_accuracy_ = sq::ACCURACY_HIGH;
+  else if(accuracy == "fast")
+    kernel_accuracy_ = sq::ACCURACY_FAST;
+  else
+    return false;
+  return true;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::localRotation() const
+{
+  return so3_rotation_ && jacobian_method_ == JACOBIAN_ANALYTIC && !has_support_plane_;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setParallelThreshold(int points)
+{
+  parallel_threshold_ = std::max(points, 0);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setBounds(bool bounded, double min_size, double max_size)
+{
+  bounded_ = bounded;
+  min_size_ = min_size;
+  max_size_ = max_size;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setSupportPlane(const Eigen::Vector4d &plane, bool tangent)
+{
+  const double norm = plane.head<3>().norm();
+  has_support_plane_ = norm > 0;
+  support_plane_ = has_support_plane_ ? Eigen::Vector4d(plane / norm) : Eigen::Vector4d::Zero();
+  support_tangent_ = tangent;
+}
+
+template<typename PointType>
+const sq::CloudStatistics& SuperquadricFittingT<PointType>::statistics()
+{
+  if(!has_statistics_)
+  {
+    sq::cloudStatistics(*cloud_, statistics_);
+    has_statistics_ = true;
+  }
+  return statistics_;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setSymmetric(bool symmetric)
+{
+  symmetric_ = symmetric;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::symmetric() const
+{
+  return symmetric_ && !has_support_plane_;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::symmetryAlign(Eigen::Affine3f &transform_inv)
+{
+  const Eigen::Vector3f center = transform_inv * statistics().center().template cast<float>();
+  transform_inv.pretranslate(-center);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setPrimitives(bool primitives, double max_distance)
+{
+  primitives_ = primitives;
+  primitive_distance_ = max_distance;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setMomentTable(const sq::MomentTable *table)
+{
+  moment_table_ = table;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setNormals(const pcl::PointCloud<pcl::Normal>::ConstPtr &normals, double weight)
+{
+  normals_ = normals;
+  normal_weight_ = weight;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::setLossScale(double scale)
+{
+  loss_scale_ = scale;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::computePreAlignedCloud(Eigen::Affine3f &transform_inv, Eigen::Vector3f &variances)
+{
+  if(has_support_plane_)
+    supportAlign(transform_inv, variances);
+  else if(pre_align_)
     preAlign(transform_inv, variances);
-    prealigned_cloud_.reset(new pcl::PointCloud<PointT>);
-    pcl::transformPointCloud(*cloud_, *prealigned_cloud_, transform_inv);
+  else
+    transform_inv = Eigen::Affine3f::Identity();
+  if(symmetric())
+    symmetryAlign(transform_inv);
+  prealign_transform_ = transform_inv;
+  sq::cloudToBuffer(*cloud_, transform_inv.cast<double>(), prealigned_points_);
+  alignNormals(transform_inv, prealigned_normals_);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::alignNormals(const Eigen::Affine3f &transform_inv, sq::PointBuffer &aligned)
+{
+  if(!normals_ || normal_weight_ <= 0 || normals_->points.size() != cloud_->points.size())
+  {
+    //cleared rather than released, the memory belongs to the context
+    aligned.x.clear();
+    aligned.y.clear();
+    aligned.z.clear();
+    return;
   }
+  const size_t n = normals_->points.size();
+  aligned.x.resize(n);
+  aligned.y.resize(n);
+  aligned.z.resize(n);
+  const Eigen::Matrix3d rotation = transform_inv.rotation().cast<double>();
+  for(size_t i=0;i<n;++i)
+  {
+    const pcl::Normal& normal = normals_->points[i];
+    Eigen::Vector3d m = Eigen::Vector3d::Zero();
+    if(std::isfinite(normal.normal_x) && std::isfinite(normal.normal_y) && std::isfinite(normal.normal_z))
+    {
+      m = rotation * Eigen::Vector3d(normal.normal_x, normal.normal_y, normal.normal_z);
+      const double norm = m.norm();
+      m = norm > 0 ? Eigen::Vector3d(m / norm) : Eigen::Vector3d::Zero();
+    }
+    aligned.x[i] = m[0];
+    aligned.y[i] = m[1];
+    aligned.z[i] = m[2];
+  }
+}
 
-  Eigen::Affine3d trans_new = (transform_inv.inverse()).cast<double>();
-  double tx, ty, tz, ax, ay, az;
-  sq::getParamFromPose(trans_new, tx, ty, tz, ax, ay, az);
+template<typename PointType>
+void SuperquadricFittingT<PointType>::supportAlign(Eigen::Affine3f &transform, Eigen::Vector3f &variances)
+{
+  const sq::CloudStatistics& cloud_statistics = statistics();
+  const Eigen::Vector3f centroid = cloud_statistics.centroid.cast<float>();
+  Eigen::Vector3f normal = support_plane_.head<3>().cast<float>();
+  float distance = normal.dot(centroid) + static_cast<float>(support_plane_(3));
+  if(distance < 0)
+  {
+    normal = -normal;
+    distance = -distance;
+  }
+  const Eigen::Vector3f origin = centroid - distance * normal;
 
+  //principal axes of the points projected on the plane, whose centroid is the origin
+  const Eigen::Vector3f u = normal.unitOrthogonal();
+  const Eigen::Vector3f v = normal.cross(u);
+  Eigen::Matrix<float, 3, 2> plane_basis;
+  plane_basis << u, v;
+  const Eigen::Matrix2f covariance = plane_basis.transpose() * cloud_statistics.covariance.cast<float>() * plane_basis;
+  float max_height = 0;
+  for(size_t i=0;i<cloud_->size();++i)
+    max_height = std::max(max_height, (cloud_->points[i].getVector3fMap() - origin).dot(normal));
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix2f> solver(covariance);
+  //eigen values are in increasing order, x is the major axis
+  const Eigen::Vector2f major = solver.eigenvectors().col(1);
+  const Eigen::Vector3f x_axis = major(0) * u + major(1) * v;
 
+  Eigen::Matrix3f rotation;
+  rotation.row(0) = x_axis;
+  rotation.row(1) = normal.cross(x_axis);
+  rotation.row(2) = normal;
+  transform = Eigen::Affine3f(rotation) * Eigen::Translation3f(-origin);
+  variances(0) = sqrt(std::max(solver.eigenvalues()(1), 0.f));
+  variances(1) = sqrt(std::max(solver.eigenvalues()(0), 0.f));
+  //the initial a3 is half of the height, the center is at a3 above the plane
+  variances(2) = max_height / 6.;
+}
 
-  int n_unknowns = 11;
-  Eigen::VectorXd xvec(n_unknowns);
-  xvec[0] = variances(0) * 3.;
-  xvec[1] = variances(1) * 3.;
-  xvec[2] = variances(2) * 3.;
-  xvec[3] = xvec[4] = 1.0;
-  xvec[5] =  xvec[6] =  xvec[7] =  xvec[8] = xvec[9] =  xvec[10] =0.;
-  /*xvec[5] = tx;
-  xvec[6] = ty;
-  xvec[7] = tz;
-  xvec[8] = ax;
-  xvec[9] = ay;
-  xvec[10] = az;*/
-
-  OptimizationFunctor functor(prealigned_cloud_->size(), this);
-  Eigen::NumericalDiff<OptimizationFunctor> numericalDiffMyFunctor(functor);
-  Eigen::LevenbergMarquardt<Eigen::NumericalDiff<OptimizationFunctor>, double> lm(numericalDiffMyFunctor);
-  lm.minimize(xvec);
+template<typename PointType>
+void SuperquadricFittingT<PointType>::supportParameters(Eigen::Ref<Eigen::VectorXd> xvec) const
+{
+  //the yaw of the rotation about the normal, z of the pre aligned points
+  Eigen::Affine3d rotation;
+  sq::create_rotation_matrix(xvec[8], xvec[9], xvec[10], rotation);
+  xvec[8] = xvec[9] = 0.;
+  xvec[10] = atan2(rotation(1, 0), rotation(0, 0));
+  if(support_tangent_)
+    xvec[7] = -xvec[2];
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::getJacobian(const Eigen::VectorXd &xvec, Eigen::MatrixXd &fjac)
+{
+  if(prealigned_points_.size() == 0)
+  {
+    Eigen::Affine3f transform_inv;
+    Eigen::Vector3f variances;
+    computePreAlignedCloud(transform_inv, variances);
+  }
+  OptimizationFunctor functor(&prealigned_points_, NULL, this);
+  if(loss_ != LOSS_SQUARED)
+    functor.loss_scale_ = loss_scale_ > 0 ? loss_scale_ : robustScale(prealigned_points_, xvec, context_->arena);
+  fjac.resize(functor.values(), functor.inputs());
+  if(jacobian_method_ == JACOBIAN_NUMERICAL)
+  {
+    Eigen::NumericalDiff<OptimizationFunctor> numericalDiffMyFunctor(functor);
+    numericalDiffMyFunctor.df(xvec, fjac);
+  }
+  else
+    functor.df(xvec, fjac);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::fit_Param(sq_fitting::sq& param, double& final_error)
+{
+  Eigen::Affine3f transform_inv;
+  Eigen::Vector3f variances;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  computePreAlignedCloud(transform_inv, variances);
+  report_.prealign_time += elapsed(start);
+  sq_fitting::sq param_lm;
+  Vector11d xvec;
+  if(startParameters(transform_inv, variances, xvec, final_error))
+  {
+    vectorToParam(xvec, transform_inv, param, param_lm);
+    return;
+  }
+  minimizePyramid(prealigned_points_, &prealigned_normals_, xvec, report_, *context_);
+  vectorToParam(xvec, transform_inv, param, param_lm);
+  start = std::chrono::steady_clock::now();
+  final_error = sq::sq_error(prealigned_points_, param_lm);
+  report_.error_time += elapsed(start);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::fitPreAligned(const sq::PointBuffer &points, const sq::PointBuffer *normals,
+                                                    const Eigen::Affine3f &transform_inv, const Eigen::Vector3f &variances, sq_fitting::sq &param, sq_fitting::sq &param_lm,
+                                                    FitReport &report, sq::FittingContext &context,
+                                                    std::atomic<double> *best_cost)
+{
+  Vector11d xvec;
+  initialParameters(transform_inv, variances, xvec);
+  minimizePyramid(points, normals, xvec, report, context, best_cost);
+  vectorToParam(xvec, transform_inv, param, param_lm);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::initialParameters(const Eigen::Affine3f &transform_inv, const Eigen::Vector3f &variances,
+                                                        Vector11d &xvec)
+{
+  if(has_initial_guess_)
+  {
+    //the guess pose maps the superquadric to the input cloud, LM maps the pre aligned
+    //points to the superquadric
+    Eigen::Affine3d guess_pose;
+    tf::poseMsgToEigen(initial_guess_.pose, guess_pose);
+    Eigen::Affine3d trans_guess = guess_pose.inverse() * transform_inv.inverse().cast<double>();
+    xvec[0] = initial_guess_.a1;
+    xvec[1] = initial_guess_.a2;
+    xvec[2] = initial_guess_.a3;
+    xvec[3] = initial_guess_.e1;
+    xvec[4] = initial_guess_.e2;
+    sq::getParamFromPose(trans_guess, xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10]);
+  }
+  else
+  {
+    xvec[0] = variances(0) * 3.;
+    xvec[1] = variances(1) * 3.;
+    xvec[2] = variances(2) * 3.;
+    xvec[3] = xvec[4] = 1.0;
+    xvec[5] =  xvec[6] =  xvec[7] =  xvec[8] = xvec[9] =  xvec[10] =0.;
+    //the pre aligned origin is on the support plane, the center is a3 above it
+    if(has_support_plane_)
+      xvec[7] = -xvec[2];
+  }
+  if(has_support_plane_)
+    supportParameters(xvec);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::minimizePyramid(const sq::PointBuffer &points, const sq::PointBuffer *normals,
+                                                      Vector11d &xvec, FitReport &report, sq::FittingContext &context,
+                                                      std::atomic<double> *best_cost)
+{
+  //coarse levels converge on few points, finer levels only refine the warm start
+  for(size_t i=0;i<pyramid_budgets_.size();++i)
+  {
+    const int budget = pyramid_budgets_[i];
+    if(budget <= 0 || static_cast<size_t>(budget) >= points.size())
+    {
+      minimize(points, normals, xvec, report, context, best_cost);
+      break;
+    }
+    sq::downsampleBuffer(points, normals, budget, context.level_points, &context.level_normals);
+    const bool last_level = i + 1 == pyramid_budgets_.size();
+    minimize(context.level_points, &context.level_normals, xvec, report, context, last_level ? best_cost : NULL);
+  }
+  if(pyramid_budgets_.empty())
+    minimize(points, normals, xvec, report, context, best_cost);
+}
 
+template<typename PointType>
+void SuperquadricFittingT<PointType>::vectorToParam(const Vector11d &xvec, const Eigen::Affine3f &transform_inv,
+                                                    sq_fitting::sq &param, sq_fitting::sq &param_lm)
+{
   param.a1 = xvec[0];
   param.a2 = xvec[1];
   param.a3 = xvec[2];
@@ -209,9 +660,9 @@ void SuperquadricFitting::fit_Param(sq_fitting::sq& param, double& final_error)
   //std::cout<<"Transformation frm LM: "<<xvec[5]<<" "<<xvec[6]<<" "<< xvec[7]<<" "<<xvec[8]<<" "<<xvec[9]<<" "<<xvec[10]<<std::endl;
   sq::create_transformation_matrix(xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10], transform_lm);
 
+  //transform_lm maps the pre aligned points to the superquadric, the pose is the inverse
   Eigen::Affine3f transform = transform_inv.inverse();
-  Eigen::Affine3d final_transform = transform.cast<double>();// * transform_lm ;
-  //Eigen::Affine3d final_transform = transform.cast<double>() ;
+  Eigen::Affine3d final_transform = transform.cast<double>() * transform_lm.inverse();
   Eigen::Vector3d t = final_transform.translation();
   param.pose.position.x = t(0);
   param.pose.position.y = t(1);
@@ -226,7 +677,6 @@ void SuperquadricFitting::fit_Param(sq_fitting::sq& param, double& final_error)
 
 
   //Creating a new param with pose of transform_lm to calculate error
-  sq_fitting::sq param_lm;
   param_lm.a1 = param.a1;
   param_lm.a2 = param.a2;
   param_lm.a3 = param.a3;
@@ -243,11 +693,716 @@ void SuperquadricFitting::fit_Param(sq_fitting::sq& param, double& final_error)
   param_lm.pose.orientation.y = q1.y();
   param_lm.pose.orientation.z = q1.z();
   param_lm.pose.orientation.w = q1.w();
-  final_error = sq::sq_error(cloud_, param_lm);
 }
 
-void SuperquadricFitting::fit()
+template<typename PointType>
+double SuperquadricFittingT<PointType>::robustScale(const sq::PointBuffer &points, const Vector11d &xvec, sq::Arena &arena)
+{
+  sq::SQKernelParam param;
+  sq::create_kernel_param(xvec, param);
+  param.accuracy = kernel_accuracy_;
+  sq::Arena::Scope scope(arena);
+  const size_t n = points.size();
+  double* residual = arena.allocate<double>(n);
+  sq::sq_batch_radial_residual(points.x.data(), points.y.data(), points.z.data(), n, param, residual);
+  for(size_t i=0;i<n;++i)
+    residual[i] = std::abs(residual[i]);
+  std::nth_element(residual, residual + n / 2, residual + n);
+  const double sigma = 1.4826 * residual[n / 2];
+  //tuning constants with 95% efficiency on gaussian residuals
+  const double tuning = loss_ == LOSS_HUBER ? 1.345 : 2.385;
+  return std::max(tuning * sigma, std::numeric_limits<double>::epsilon());
+}
+
+/**
+ * @brief reason Eigen::LevenbergMarquardt stopped, with the names of minimizeNormal
+ */
+static std::string termination_reason(const Eigen::LevenbergMarquardtSpace::Status status)
+{
+  switch(status)
+  {
+  case Eigen::LevenbergMarquardtSpace::RelativeReductionTooSmall:
+  case Eigen::LevenbergMarquardtSpace::RelativeErrorAndReductionTooSmall:
+    return "relative_reduction";
+  case Eigen::LevenbergMarquardtSpace::RelativeErrorTooSmall:
+    return "small_step";
+  case Eigen::LevenbergMarquardtSpace::CosinusTooSmall:
+    return "zero_gradient";
+  case Eigen::LevenbergMarquardtSpace::TooManyFunctionEvaluation:
+    return "max_iterations";
+  case Eigen::LevenbergMarquardtSpace::FtolTooSmall:
+  case Eigen::LevenbergMarquardtSpace::XtolTooSmall:
+  case Eigen::LevenbergMarquardtSpace::GtolTooSmall:
+    return "no_progress";
+  default:
+    return "failed";
+  }
+}
+
+/**
+ * @brief true if a multi start hypothesis converges to a worse minimum than the best one: its
+ * mean squared residual is above the best final one and fell by less than 1% since
+ * reference_cost, which is taken every 5 accepted steps. Rejected steps only grow the damping,
+ * and a hypothesis crawling along a valley can still fall by orders of magnitude, so neither
+ * abandons it
+ */
+static bool abandon_hypothesis(const double cost, const int accepted_steps, double& reference_cost,
+                               const std::atomic<double>& best_cost)
+{
+  const int check_steps = 5;
+  if(accepted_steps % check_steps != 0)
+    return false;
+  const bool stalled = cost > 0.99 * reference_cost;
+  reference_cost = cost;
+  return stalled && cost > best_cost;
+}
+
+/**
+ * @brief lowers the best final cost of the multi start hypotheses to cost
+ */
+static void lower_best_cost(std::atomic<double>& best_cost, const double cost)
+{
+  double current = best_cost;
+  while(cost < current && !best_cost.compare_exchange_weak(current, cost));
+}
+
+/**
+ * @brief Eigen::LevenbergMarquardt::minimize, abandoned between iterations if best_cost is not
+ * NULL, see SuperquadricFittingT::minimize
+ * @param n number of residuals
+ */
+template<typename LM>
+static std::string minimize_lm(LM& lm, Eigen::VectorXd& x, const int n, std::atomic<double>* best_cost)
+{
+  Eigen::LevenbergMarquardtSpace::Status status = lm.minimizeInit(x);
+  if(status == Eigen::LevenbergMarquardtSpace::ImproperInputParameters)
+    return termination_reason(status);
+  //every iteration of minimizeOneStep ends on an accepted step
+  double reference_cost = lm.fnorm * lm.fnorm / n;
+  do
+  {
+    status = lm.minimizeOneStep(x);
+    if(best_cost && status == Eigen::LevenbergMarquardtSpace::Running &&
+       abandon_hypothesis(lm.fnorm * lm.fnorm / n, lm.iter, reference_cost, *best_cost))
+      return "abandoned";
+  } while(status == Eigen::LevenbergMarquardtSpace::Running);
+  if(best_cost)
+    lower_best_cost(*best_cost, lm.fnorm * lm.fnorm / n);
+  return termination_reason(status);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::minimize(const sq::PointBuffer &points, const sq::PointBuffer *normals,
+                                               Vector11d &xvec, FitReport &report, sq::FittingContext &context,
+                                               std::atomic<double> *best_cost)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  OptimizationFunctor functor(&points, normals, this);
+  functor.arena_ = &context.arena;
+  if(loss_ != LOSS_SQUARED)
+    functor.loss_scale_ = loss_scale_ > 0 ? loss_scale_ : robustScale(points, xvec, context.arena);
+  const bool single_precision = float_precision_ && jacobian_method_ == JACOBIAN_ANALYTIC;
+  if(single_precision)
+  {
+    sq::bufferToFloat(points, context.points_f);
+    functor.points_f_ = &context.points_f;
+  }
+
+  //same tolerances and budget as Eigen::LevenbergMarquardt, single precision stops at its
+  //resolution and leaves the rest to the polish
+  const int max_iterations = MAX_ITERATIONS;
+  const double tolerance = sqrt(single_precision ? std::numeric_limits<float>::epsilon() :
+                                                   std::numeric_limits<double>::epsilon());
+  if(jacobian_method_ == JACOBIAN_NUMERICAL)
+  {
+    Eigen::NumericalDiff<OptimizationFunctor> numericalDiffMyFunctor(functor);
+    Eigen::LevenbergMarquardt<Eigen::NumericalDiff<OptimizationFunctor>, double> lm(numericalDiffMyFunctor);
+    Eigen::VectorXd x = xvec;
+    report.termination = minimize_lm(lm, x, functor.values(), best_cost);
+    xvec = x;
+    report.iterations += lm.iter;
+    report.function_evaluations += lm.nfev;
+    report.jacobian_evaluations += lm.njev;
+  }
+  else if(normal_solver_ || bounded_ || localRotation() || has_support_plane_ || symmetric() || functor.normals_)
+    report.termination = minimizeNormal(functor, xvec, max_iterations, tolerance, report, best_cost);
+  else
+  {
+    Eigen::LevenbergMarquardt<OptimizationFunctor, double> lm(functor);
+    lm.parameters.ftol = lm.parameters.xtol = tolerance;
+    Eigen::VectorXd x = xvec;
+    report.termination = minimize_lm(lm, x, functor.values(), best_cost);
+    xvec = x;
+    report.iterations += lm.iter;
+    report.function_evaluations += lm.nfev;
+    report.jacobian_evaluations += lm.njev;
+  }
+
+  if(single_precision && report.termination != "abandoned")
+  {
+    //the termination of the polish is not interesting, it stops after its iterations
+    const int polish_iterations = 2;
+    functor.points_f_ = NULL;
+    minimizeNormal(functor, xvec, polish_iterations, sqrt(std::numeric_limits<double>::epsilon()), report);
+  }
+  report.lm_time += elapsed(start);
+}
+
+template<typename PointType>
+const char* SuperquadricFittingT<PointType>::minimizeNormal(const OptimizationFunctor &functor, Vector11d &xvec,
+                                                            const int max_iterations, const double tolerance, FitReport &report,
+                                                            std::atomic<double> *best_cost)
 {
+  NormalState state;
+  initNormal(functor, xvec, state, report);
+  const int n = functor.values();
+  double reference_cost = state.cost / n;
+  int accepted_steps = 0;
+  while(!state.termination && state.iterations < max_iterations)
+  {
+    const double previous_cost = state.cost;
+    iterateNormal(functor, tolerance, state, report);
+    if(best_cost && !state.termination && state.cost < previous_cost &&
+       abandon_hypothesis(state.cost / n, ++accepted_steps, reference_cost, *best_cost))
+    {
+      xvec = state.x;
+      return "abandoned";
+    }
+  }
+  xvec = state.x;
+  if(best_cost)
+    lower_best_cost(*best_cost, state.cost / n);
+  return state.termination ? state.termination : "max_iterations";
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::computeBounds(const OptimizationFunctor &functor, NormalState &state)
+{
+  const sq::PointBuffer& points = *functor.points_;
+  const std::size_t n = points.size();
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+  for(std::size_t i=0;i<n;++i)
+    centroid += Eigen::Vector3d(points.x[i], points.y[i], points.z[i]);
+  centroid /= std::max<std::size_t>(n, 1);
+  double radius = 0;
+  for(std::size_t i=0;i<n;++i)
+    radius = std::max(radius, (Eigen::Vector3d(points.x[i], points.y[i], points.z[i]) - centroid).norm());
+
+  //the translation maps the points to the superquadric, its norm is the distance of the
+  //center of the superquadric to the origin of the points
+  const double max_size = max_size_ > 0 ? max_size_ : radius;
+  const double max_translation = centroid.norm() + radius;
+  const double infinity = std::numeric_limits<double>::infinity();
+  state.lower << min_size_, min_size_, min_size_, 0.1, 0.1,
+      -max_translation, -max_translation, -max_translation, -infinity, -infinity, -infinity;
+  state.upper << max_size, max_size, max_size, 1.9, 1.9,
+      max_translation, max_translation, max_translation, infinity, infinity, infinity;
+  state.upper.template head<3>() = state.upper.template head<3>().cwiseMax(state.lower.template head<3>());
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::initNormal(const OptimizationFunctor &functor, const Vector11d &xvec,
+                                                 NormalState &state, FitReport &report)
+{
+  state.x = xvec;
+  state.local_rotation = localRotation();
+  state.bounded = bounded_;
+  state.constrained = has_support_plane_ || symmetric();
+  if(symmetric())
+  {
+    //the center of the superquadric stays at the pre aligned origin
+    state.x.template segment<3>(5).setZero();
+    state.basis.setIdentity();
+    state.basis(5, 5) = state.basis(6, 6) = state.basis(7, 7) = 0.;
+  }
+  else if(state.constrained)
+  {
+    //ax and ay are held, a tangent plane moves tz with a3
+    supportParameters(state.x);
+    state.basis.setIdentity();
+    state.basis(8, 8) = state.basis(9, 9) = 0.;
+    if(support_tangent_)
+    {
+      state.basis(7, 7) = 0.;
+      state.basis(7, 2) = -1.;
+    }
+  }
+  if(state.bounded)
+  {
+    computeBounds(functor, state);
+    state.x = state.x.cwiseMax(state.lower).cwiseMin(state.upper);
+    if(has_support_plane_)
+      supportParameters(state.x);
+  }
+  state.cost = functor.normalEquations(state.x, &state.JtJ, &state.Jtr);
+  ++report.function_evaluations;
+  ++report.jacobian_evaluations;
+  //damping scaled by the largest diagonal of J^T J so far, as in minpack
+  state.scale = state.JtJ.diagonal().cwiseMax(std::numeric_limits<double>::epsilon());
+  state.lambda = 1e-3;
+  state.nu = 2.;
+  state.iterations = 0;
+  state.termination = NULL;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::iterateNormal(const OptimizationFunctor &functor, const double tolerance,
+                                                    NormalState &state, FitReport &report)
+{
+  //unknowns on a bound with the descent direction pointing out of the box are held
+  Matrix11d damped = state.JtJ;
+  Vector11d gradient = state.Jtr;
+  Vector11d scale = state.scale;
+  if(state.constrained)
+  {
+    //normal equations of the step s in the subspace, zero columns of the basis are held
+    damped = state.basis.transpose() * state.JtJ * state.basis;
+    gradient = state.basis.transpose() * state.Jtr;
+    scale = (state.basis.transpose() * state.scale.asDiagonal() * state.basis).diagonal();
+    for(int i=0;i<11;++i)
+    {
+      if(state.basis.col(i).isZero(0.))
+      {
+        damped(i, i) = 1.;
+        scale[i] = 0;
+      }
+    }
+  }
+  if(state.bounded)
+  {
+    for(int i=0;i<11;++i)
+    {
+      if((state.x[i] <= state.lower[i] && gradient[i] > 0) || (state.x[i] >= state.upper[i] && gradient[i] < 0))
+      {
+        damped.row(i).setZero();
+        damped.col(i).setZero();
+        damped(i, i) = 1.;
+        gradient[i] = 0;
+      }
+    }
+  }
+  if(gradient.isZero(0.))
+  {
+    state.termination = "zero_gradient";
+    return true;
+  }
+  ++state.iterations;
+  ++report.iterations;
+  damped.diagonal() += state.lambda * scale;
+  Vector11d step = damped.ldlt().solve(-gradient);
+  double predicted = -step.dot(gradient) + state.lambda * step.dot(scale.cwiseProduct(step));
+  if(state.constrained)
+    step = state.basis * step;
+  Vector11d x_new = state.x + step;
+  if(state.bounded)
+  {
+    //the reduction predicted by the linearization for the step projected on the box
+    x_new = x_new.cwiseMax(state.lower).cwiseMin(state.upper);
+    if(has_support_plane_ && support_tangent_)
+      x_new[7] = -x_new[2];
+    step.head<8>() = x_new.head<8>() - state.x.template head<8>();
+    predicted = -2. * step.dot(state.Jtr) - step.dot(state.JtJ * step);
+  }
+  if(state.local_rotation)
+  {
+    //the euler angles of the rotation vector step composed on the left of the rotation
+    Eigen::Affine3d rotation;
+    sq::create_rotation_matrix(state.x[8], state.x[9], state.x[10], rotation);
+    const Eigen::Vector3d delta = step.tail<3>();
+    const double angle = delta.norm();
+    if(angle > 0)
+      rotation = Eigen::AngleAxisd(angle, delta / angle) * rotation;
+    Eigen::Vector3d euler = rotation.linear().eulerAngles(0, 2, 1);
+    x_new[8] = euler[0];
+    x_new[9] = euler[2];
+    x_new[10] = euler[1];
+  }
+  const bool small_step = step.norm() <= tolerance * (state.x.norm() + tolerance);
+  const double cost_new = functor.normalEquations(x_new, NULL, NULL);
+  ++report.function_evaluations;
+  const double actual = state.cost - cost_new;
+  if(actual > 0 && predicted > 0)
+  {
+    //gain ratio update of Nielsen
+    const double rho = actual / predicted;
+    state.lambda *= std::max(1. / 3., 1. - pow(2. * rho - 1., 3));
+    state.nu = 2.;
+    state.x = x_new;
+    state.cost = functor.normalEquations(x_new, &state.JtJ, &state.Jtr);
+    ++report.function_evaluations;
+    ++report.jacobian_evaluations;
+    state.scale = state.scale.cwiseMax(state.JtJ.diagonal());
+    if(actual <= tolerance * cost_new && predicted <= tolerance * cost_new)
+      state.termination = "relative_reduction";
+    else if(small_step)
+      state.termination = "small_step";
+  }
+  else if(small_step)
+    state.termination = "no_progress";
+  else
+  {
+    state.lambda *= state.nu;
+    state.nu *= 2.;
+  }
+  return state.termination != NULL;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::initStep()
+{
+  resetReport();
+  context_->reset();
+  report_.n_points = cloud_->size();
+  setPreAlign(true, 0);
+  Eigen::Affine3f transform_inv;
+  Eigen::Vector3f variances;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  computePreAlignedCloud(transform_inv, variances);
+  report_.prealign_time += elapsed(start);
+
+  Vector11d xvec;
+  double error;
+  if(startParameters(transform_inv, variances, xvec, error))
+  {
+    sq_fitting::sq param_lm;
+    vectorToParam(xvec, transform_inv, params_, param_lm);
+    min_error_ = error;
+    report_.final_error = min_error_;
+    step_.lm.x = xvec;
+    step_.started = true;
+    step_.finished = true;
+    return;
+  }
+  start = std::chrono::steady_clock::now();
+  step_.level = 0;
+  step_.finished = false;
+  startLevel(xvec);
+  step_.started = true;
+  report_.lm_time += elapsed(start);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::startLevel(const Vector11d &xvec)
+{
+  //the same levels as minimizePyramid
+  step_.points = &prealigned_points_;
+  step_.normals = &prealigned_normals_;
+  if(step_.level < pyramid_budgets_.size())
+  {
+    const int budget = pyramid_budgets_[step_.level];
+    if(budget > 0 && static_cast<size_t>(budget) < prealigned_points_.size())
+    {
+      sq::downsampleBuffer(prealigned_points_, &prealigned_normals_, budget, context_->level_points,
+                           &context_->level_normals);
+      step_.points = &context_->level_points;
+      step_.normals = &context_->level_normals;
+    }
+  }
+  step_.last_level = step_.points == &prealigned_points_ || step_.level + 1 >= pyramid_budgets_.size();
+  OptimizationFunctor functor(step_.points, step_.normals, this);
+  if(loss_ != LOSS_SQUARED)
+    functor.loss_scale_ = loss_scale_ > 0 ? loss_scale_ : robustScale(*step_.points, xvec, context_->arena);
+  step_.loss_scale = functor.loss_scale_;
+  initNormal(functor, xvec, step_.lm, report_);
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::step(int n)
+{
+  if(step_.finished)
+    return true;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const double tolerance = sqrt(std::numeric_limits<double>::epsilon());
+  for(int i=0;i<n && !step_.finished;++i)
+  {
+    OptimizationFunctor functor(step_.points, step_.normals, this);
+    functor.loss_scale_ = step_.loss_scale;
+    iterateNormal(functor, tolerance, step_.lm, report_);
+    if(!step_.lm.termination && step_.lm.iterations >= MAX_ITERATIONS)
+      step_.lm.termination = "max_iterations";
+    if(!step_.lm.termination)
+      continue;
+    if(!step_.last_level)
+    {
+      ++step_.level;
+      const Vector11d xvec = step_.lm.x;
+      startLevel(xvec);
+      continue;
+    }
+
+    report_.lm_time += elapsed(start);
+    start = std::chrono::steady_clock::now();
+    sq_fitting::sq param_lm;
+    vectorToParam(step_.lm.x, prealign_transform_, params_, param_lm);
+    min_error_ = sq::sq_error(prealigned_points_, param_lm);
+    report_.final_error = min_error_;
+    report_.termination = step_.lm.termination;
+    report_.error_time += elapsed(start);
+    step_.finished = true;
+    return true;
+  }
+  report_.lm_time += elapsed(start);
+  return step_.finished;
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::getCurrentBest(sq_fitting::sq &param)
+{
+  if(!step_.started)
+    return false;
+  //Levenberg-Marquardt only accepts steps reducing the error, the current parameters are the best
+  sq_fitting::sq param_lm;
+  vectorToParam(step_.lm.x, prealign_transform_, param, param_lm);
+  return true;
+}
+
+/**
+ * @brief rotation of multi start hypothesis i, moving pre align axis (i + 2) % 3 on z
+ * with a cyclic permutation, optionally followed by 45 degrees about z
+ */
+static Eigen::Matrix3f hypothesis_rotation(const int i, const bool rotated)
+{
+  Eigen::Matrix3f rotation = Eigen::Matrix3f::Zero();
+  for(int j=0;j<3;++j)
+    rotation(j, (i + j) % 3) = 1;
+  if(rotated)
+    rotation = Eigen::AngleAxisf(M_PI / 4., Eigen::Vector3f::UnitZ()).toRotationMatrix() * rotation;
+  return rotation;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::hypothesisParameters(const int i, const bool rotated, const Eigen::Vector3f &variances,
+                                                           Vector11d &xvec)
+{
+  for(int j=0;j<3;++j)
+    xvec[j] = variances((i + j) % 3) * 3.;
+  xvec[3] = xvec[4] = 1.0;
+  Eigen::Affine3d rotation(hypothesis_rotation(i, rotated).cast<double>());
+  sq::getParamFromPose(rotation, xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10]);
+}
+
+/**
+ * @brief parameters of a superquadric whose axis j is axis (axis + j) % 3 of the pre aligned
+ * points, with the rotation of multi start hypothesis axis
+ * @param size along every axis of the pre aligned points
+ * @param center in the pre aligned points
+ */
+static void alignedParameters(const Eigen::Vector3d& size, const Eigen::Vector3d& center, const double e1,
+                              const double e2, const int axis, Eigen::Matrix<double, 11, 1>& xvec)
+{
+  for(int j=0;j<3;++j)
+    xvec[j] = size((axis + j) % 3);
+  xvec[3] = e1;
+  xvec[4] = e2;
+  const Eigen::Affine3d transform = Eigen::Affine3d(hypothesis_rotation(axis, false).cast<double>()) *
+      Eigen::Translation3d(-center);
+  sq::getParamFromPose(transform, xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10]);
+}
+
+template<typename PointType>
+bool SuperquadricFittingT<PointType>::startParameters(const Eigen::Affine3f &transform_inv, const Eigen::Vector3f &variances,
+                                                      Vector11d &xvec, double &error)
+{
+  initialParameters(transform_inv, variances, xvec);
+  if(has_initial_guess_ || has_support_plane_ || symmetric() || (!primitives_ && !moment_table_))
+    return false;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const sq::PointBuffer& points = prealigned_points_;
+  const std::size_t n = points.size();
+  bool moments = false;
+  if(moment_table_)
+  {
+    sq::MomentDescriptor descriptor;
+    sq::MomentTable::Shape shape;
+    sq::momentDescriptor(points, descriptor);
+    moments = moment_table_->lookup(descriptor, shape);
+    if(moments)
+      alignedParameters(shape.size.cwiseMax(1e-3), descriptor.center, shape.e1, shape.e2, (shape.axis + 1) % 3, xvec);
+  }
+  if(!primitives_)
+  {
+    if(moments)
+      report_.primitive = "moments";
+    report_.primitive_time += elapsed(start);
+    return false;
+  }
+
+  //bounding box, and the normal equations of the axis aligned ellipsoid
+  //k0 x^2 + k1 y^2 + k2 z^2 + k3 x + k4 y + k5 z = 1
+  Eigen::Vector3d min_pt = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d max_pt = -min_pt;
+  Eigen::Matrix<double, 6, 6> AtA = Eigen::Matrix<double, 6, 6>::Zero();
+  Eigen::Matrix<double, 6, 1> Atb = Eigen::Matrix<double, 6, 1>::Zero();
+  for(std::size_t i=0;i<n;++i)
+  {
+    const Eigen::Vector3d p(points.x[i], points.y[i], points.z[i]);
+    min_pt = min_pt.cwiseMin(p);
+    max_pt = max_pt.cwiseMax(p);
+    Eigen::Matrix<double, 6, 1> row;
+    row << p.cwiseProduct(p), p;
+    AtA.noalias() += row * row.transpose();
+    Atb += row;
+  }
+
+  //primitive with fixed exponents, its axis j is axis (axis + j) % 3 of the pre aligned points
+  struct Primitive
+  {
+    const char* name;
+    Eigen::Vector3d size;
+    Eigen::Vector3d center;
+    double e1;
+    double e2;
+    int axis;
+  };
+  const double min_size = 1e-3;
+  const Eigen::Vector3d box_size = (0.5 * (max_pt - min_pt)).cwiseMax(min_size);
+  const Eigen::Vector3d box_center = 0.5 * (max_pt + min_pt);
+  Primitive primitives[5];
+  int n_primitives = 0;
+  const Primitive box = {"box", box_size, box_center, 0.2, 0.2, 0};
+  primitives[n_primitives++] = box;
+  for(int i=0;i<3;++i)
+  {
+    const Primitive cylinder = {"cylinder", box_size, box_center, 0.2, 1., i};
+    primitives[n_primitives++] = cylinder;
+  }
+  //(x - c)^2 k + ... = g for k > 0 is an ellipsoid of semi axes sqrt(g / k)
+  const Eigen::Matrix<double, 6, 1> k = AtA.ldlt().solve(Atb);
+  if(k.head<3>().minCoeff() > 0)
+  {
+    const Eigen::Vector3d center = -0.5 * k.tail<3>().cwiseQuotient(k.head<3>());
+    const double g = 1. + k.head<3>().dot(center.cwiseProduct(center));
+    const Eigen::Vector3d size = (g / k.head<3>().array()).sqrt().matrix().cwiseMax(min_size);
+    const Primitive ellipsoid = {"ellipsoid", size, center, 1., 1., 0};
+    if(g > 0 && size.allFinite())
+      primitives[n_primitives++] = ellipsoid;
+  }
+
+  //the errors of the primitives stop summing once worse than the best one
+  error = std::numeric_limits<double>::max();
+  const char* best_name = "none";
+  if(moments)
+  {
+    sq_fitting::sq param, param_lm;
+    vectorToParam(xvec, transform_inv, param, param_lm);
+    error = sq::sq_error(points, param_lm);
+    best_name = "moments";
+  }
+  Vector11d candidate;
+  for(int i=0;i<n_primitives;++i)
+  {
+    const Primitive& primitive = primitives[i];
+    alignedParameters(primitive.size, primitive.center, primitive.e1, primitive.e2, primitive.axis, candidate);
+    sq_fitting::sq param, param_lm;
+    vectorToParam(candidate, transform_inv, param, param_lm);
+    const double candidate_error = sq::sq_error(points, param_lm, error);
+    if(candidate_error < error)
+    {
+      error = candidate_error;
+      best_name = primitive.name;
+      xvec = candidate;
+    }
+  }
+  report_.primitive = best_name;
+  report_.primitive_time += elapsed(start);
+
+  //the squared radial residual is weighted by sqrt(a1 * a2 * a3)
+  const double weight = sqrt(std::abs(xvec[0] * xvec[1] * xvec[2]));
+  if(error > primitive_distance_ * primitive_distance_ * weight)
+    return false;
+  report_.termination = "primitive";
+  return true;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::fitMultiStart()
+{
+  setPreAlign(true, 0);
+  Eigen::Affine3f transform_inv = Eigen::Affine3f::Identity();
+  Eigen::Vector3f variances = Eigen::Vector3f::Constant(sqrt(0.25 / cloud_->size()));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  preAlign(transform_inv, variances);
+  if(symmetric())
+    symmetryAlign(transform_inv);
+  report_.prealign_time += elapsed(start);
+
+  //rotating the symmetric superquadric by 180 degrees gives the same fit, so only the
+  //axis on z and the orientation about it make a different start
+  const int n_hypotheses = multi_start_rotated_ ? 6 : 3;
+  Hypothesis hypotheses[6];
+  //every hypothesis is minimized in its own context, created before they run concurrently
+  for(int i=0;i<n_hypotheses;++i)
+  {
+    hypotheses[i].points = &context_->hypothesis(i).prealigned_points;
+    hypotheses[i].normals = &context_->hypothesis(i).prealigned_normals;
+  }
+  std::atomic<double> min_fit_error(std::numeric_limits<double>::max());
+  //hypotheses converging above the best one are abandoned, their costs are comparable unless
+  //each one estimates its own loss scale
+  std::atomic<double> best_cost(std::numeric_limits<double>::max());
+  std::atomic<double>* abandon_cost = loss_ == LOSS_SQUARED || loss_scale_ > 0 ? &best_cost : NULL;
+  const auto fit_hypothesis = [&](std::size_t i)
+  {
+    Hypothesis& h = hypotheses[i];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Eigen::Matrix3f rotation = hypothesis_rotation(i % 3, i >= 3);
+    h.transform = Eigen::Affine3f(rotation) * transform_inv;
+    for(int j=0;j<3;++j)
+      h.variances(j) = variances((i + j) % 3);
+    sq::cloudToBuffer(*cloud_, h.transform.template cast<double>(), *h.points);
+    alignNormals(h.transform, *h.normals);
+    h.report.prealign_time = elapsed(start);
+    sq_fitting::sq param_lm;
+    fitPreAligned(*h.points, h.normals, h.transform, h.variances, h.param, param_lm, h.report, context_->hypothesis(i),
+                  abandon_cost);
+    if(h.report.termination == "abandoned")
+    {
+      h.error = std::numeric_limits<double>::max();
+      return;
+    }
+
+    //stop scoring once the hypothesis is worse than the best one so far
+    start = std::chrono::steady_clock::now();
+    h.error = sq::sq_error(*h.points, param_lm, min_fit_error);
+    h.report.error_time = elapsed(start);
+    double current = min_fit_error;
+    while(h.error < current && !min_fit_error.compare_exchange_weak(current, h.error));
+  };
+  sq::ThreadPool::instance().run(n_hypotheses, std::cref(fit_hypothesis));
+
+  int min_index = 0;
+  for(int i=1;i<n_hypotheses;++i)
+  {
+    if(hypotheses[i].error < hypotheses[min_index].error)
+      min_index = i;
+  }
+  Hypothesis& best = hypotheses[min_index];
+  report_.termination = best.report.termination;
+  for(int i=0;i<n_hypotheses;++i)
+    report_.add(hypotheses[i].report);
+  params_ = best.param;
+  min_error_ = best.error;
+  prealign_transform_ = best.transform;
+  prealigned_points_.x.swap(best.points->x);
+  prealigned_points_.y.swap(best.points->y);
+  prealigned_points_.z.swap(best.points->z);
+  prealigned_normals_.x.swap(best.normals->x);
+  prealigned_normals_.y.swap(best.normals->y);
+  prealigned_normals_.z.swap(best.normals->z);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::fit()
+{
+  resetReport();
+  context_->reset();
+  report_.n_points = cloud_->size();
+  if(multi_start_ && !has_initial_guess_ && !has_support_plane_)
+  {
+    fitMultiStart();
+    report_.final_error = min_error_;
+    return;
+  }
   double min_fit_error = std::numeric_limits<double>::max();
   sq_fitting::sq min_param;
   for(int i=0;i<1;++i)
@@ -264,35 +1419,343 @@ void SuperquadricFitting::fit()
     }
   }
   params_ = min_param;
-  //min_error_ = min_fit_error; std::cout<<"min error is: "<<min_error_<<std::endl;
+  min_error_ = min_fit_error;
+  report_.final_error = min_error_;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::resetReport()
+{
+  //assigned from a copy rather than a temporary, so that the strings keep their memory
+  static const FitReport empty;
+  report_ = empty;
 }
 
-void SuperquadricFitting::getMinError(double& error)
+template<typename PointType>
+void SuperquadricFittingT<PointType>::getMinError(double& error)
 {
   error = min_error_;
 }
 
-int SuperquadricFitting::OptimizationFunctor::operator ()(const Eigen::VectorXd &xvec, Eigen::VectorXd &fvec) const
+template<typename PointType>
+void SuperquadricFittingT<PointType>::getReport(FitReport &report)
+{
+  report = report_;
+}
+
+/**
+ * @brief robust residual sign(r) * sqrt(rho(r^2)), so that Levenberg-Marquardt minimizes the
+ * sum of rho(r^2)
+ * @param huber true for the huber loss, false for the cauchy loss
+ * @param scale residual where the loss starts to differ from the squared residual
+ * @param derivative derivative of the robust residual w.r.t. r
+ */
+static double robust_residual(const bool huber, const double scale, const double r, double& derivative)
+{
+  const double s = r * r;
+  const double scale2 = scale * scale;
+  double rho, drho;
+  if(huber)
+  {
+    if(s <= scale2)
+    {
+      derivative = 1.;
+      return r;
+    }
+    rho = 2. * scale * sqrt(s) - scale2;
+    drho = scale / sqrt(s);
+  }
+  else
+  {
+    rho = scale2 * log1p(s / scale2);
+    drho = 1. / (1. + s / scale2);
+  }
+  if(rho <= 0)
+  {
+    derivative = 1.;
+    return r;
+  }
+  const double robust_r = sqrt(rho);
+  derivative = drho * std::abs(r) / robust_r;
+  return r < 0 ? -robust_r : robust_r;
+}
+
+/**
+ * @brief maps the kernel gradient w.r.t. rotations of the rotated point to the gradient w.r.t.
+ * the euler angles of the rotation rx * rz * ry, in place
+ * @param grad_rx n values of sq::GRAD_RX, unchanged since rx is the outermost rotation
+ * @param grad_ry n values of sq::GRAD_RY, replaced by the derivative w.r.t. ay
+ * @param grad_rz n values of sq::GRAD_RZ, replaced by the derivative w.r.t. az
+ */
+static void euler_gradient(const Eigen::Matrix<double, 11, 1>& xvec, const double* grad_rx, double* grad_ry, double* grad_rz,
+                           const std::size_t n)
 {
-  pcl::PointCloud<PointT>::Ptr cloud_new(new pcl::PointCloud<PointT>);
-  cloud_new = estimator_->prealigned_cloud_;
-  double a = xvec[0], b = xvec[1],
-              c = xvec[2], e1 = xvec[3],
-              e2 =xvec[4];
-  Eigen::Affine3d trans;
-  sq::create_transformation_matrix(xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10], trans);
-  pcl::PointCloud<PointT>::Ptr cloud_transformed(new pcl::PointCloud<PointT>);
-  pcl::transformPointCloud(*cloud_new, *cloud_transformed, trans);
-  for(int i=0;i<values();++i)
+  Eigen::Matrix3d rx_inv = Eigen::AngleAxisd(-xvec[8], Eigen::Vector3d::UnitX()).toRotationMatrix();
+  Eigen::Matrix3d rxz_inv = Eigen::AngleAxisd(-xvec[10], Eigen::Vector3d::UnitZ()).toRotationMatrix() * rx_inv;
+  for(std::size_t i=0;i<n;++i)
   {
-    Eigen::Matrix<double, 4, 1> xyz_tr (cloud_transformed->at(i).x, cloud_transformed->at(i).y, cloud_transformed->at(i).z, 1.);
-    double op = Eigen::Matrix<double, 3, 1> (xyz_tr[0], xyz_tr[1], xyz_tr[2]).norm ();
-    PointT p;
-    p.x = xyz_tr[0];
-    p.y = xyz_tr[1];
-    p.z = xyz_tr[2];
-    fvec[i] = op * sq::sq_function(xyz_tr[0], xyz_tr[1], xyz_tr[2], a,b,c,e1,e2) ;
+    Eigen::Vector3d m(grad_rx[i], grad_ry[i], grad_rz[i]);
+    grad_ry[i] = rxz_inv.row(1).dot(m);
+    grad_rz[i] = rx_inv.row(2).dot(m);
   }
+}
+
+template<typename PointType>
+int SuperquadricFittingT<PointType>::OptimizationFunctor::operator ()(const Eigen::VectorXd &xvec_dynamic, Eigen::VectorXd &fvec) const
+{
+  const Vector11d xvec = xvec_dynamic;
+  sq::ThreadPool::instance().runChunks(values(), sq::SQ_POINT_CHUNK_SIZE, estimator_->parallel_threshold_,
+                                       [&](std::size_t chunk, std::size_t begin, std::size_t end)
+  {
+    sq::SQKernelParam param;
+    sq::create_kernel_param(xvec, param);
+    param.accuracy = estimator_->kernel_accuracy_;
+    evaluate(xvec, param, begin, end - begin, fvec.data() + begin, NULL);
+  });
   return (0);
 }
 
+template<typename PointType>
+int SuperquadricFittingT<PointType>::OptimizationFunctor::df(const Eigen::VectorXd &xvec_dynamic, Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> &fjac) const
+{
+  const Vector11d xvec = xvec_dynamic;
+  sq::ThreadPool::instance().runChunks(values(), sq::SQ_POINT_CHUNK_SIZE, estimator_->parallel_threshold_,
+                                       [&](std::size_t chunk, std::size_t begin, std::size_t end)
+  {
+    //blocks are evaluated in cache and copied to the rows of the chunk in the column major jacobian
+    sq::SQKernelParam param;
+    sq::create_kernel_param(xvec, param);
+    param.accuracy = estimator_->kernel_accuracy_;
+    double residual[BLOCK_SIZE];
+    double grad[sq::SQ_KERNEL_GRAD_SIZE * BLOCK_SIZE];
+    for(std::size_t b=begin;b<end;b+=BLOCK_SIZE)
+    {
+      const std::size_t n = std::min<std::size_t>(BLOCK_SIZE, end - b);
+      evaluate(xvec, param, b, n, residual, grad);
+      fjac.block(b, 0, n, 11) = Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 11> >(grad, n, 11);
+    }
+  });
+  return (0);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::OptimizationFunctor::evaluate(const Vector11d &xvec, const sq::SQKernelParam &param,
+                                                                    const std::size_t begin, const std::size_t n,
+                                                                    double *residual, double *grad) const
+{
+  const sq::PointBuffer& points = *points_;
+  const bool robust = estimator_->loss_ != LOSS_SQUARED;
+  const bool huber = estimator_->loss_ == LOSS_HUBER;
+  const bool local_rotation = estimator_->localRotation();
+  if(grad && estimator_->jacobian_method_ == JACOBIAN_AUTODIFF)
+  {
+    sq::SQJet jet[11];
+    for(int j=0;j<11;++j)
+      jet[j] = sq::SQJet(xvec[j], 11, j);
+    for(std::size_t i=0;i<n;++i)
+    {
+      sq::SQJet r = sq::sq_residual(jet, points.x[begin + i], points.y[begin + i], points.z[begin + i]);
+      residual[i] = r.value();
+      for(int k=0;k<11;++k)
+        grad[k * n + i] = r.derivatives()[k];
+    }
+  }
+  else if(points_f_)
+  {
+    //single precision kernels, widened for the euler angles, the loss and the reductions
+    float residual_f[BLOCK_SIZE];
+    float grad_f[sq::SQ_KERNEL_GRAD_SIZE * BLOCK_SIZE];
+    const sq::PointBufferf& points_f = *points_f_;
+    for(std::size_t b=0;b<n;b+=BLOCK_SIZE)
+    {
+      const std::size_t m = std::min<std::size_t>(BLOCK_SIZE, n - b);
+      sq::sq_batch_radial_residual(points_f.x.data() + begin + b, points_f.y.data() + begin + b,
+                                   points_f.z.data() + begin + b, m, param, residual_f, grad ? grad_f : NULL);
+      std::copy(residual_f, residual_f + m, residual + b);
+      if(grad)
+      {
+        for(int k=0;k<sq::SQ_KERNEL_GRAD_SIZE;++k)
+          std::copy(grad_f + k * m, grad_f + (k + 1) * m, grad + k * n + b);
+      }
+    }
+    if(grad && !local_rotation)
+      euler_gradient(xvec, grad + sq::GRAD_RX * n, grad + sq::GRAD_RY * n, grad + sq::GRAD_RZ * n, n);
+  }
+  else
+  {
+    sq::sq_batch_radial_residual(points.x.data() + begin, points.y.data() + begin, points.z.data() + begin, n, param,
+                                 residual, grad);
+    if(grad && !local_rotation)
+      euler_gradient(xvec, grad + sq::GRAD_RX * n, grad + sq::GRAD_RY * n, grad + sq::GRAD_RZ * n, n);
+  }
+  if(robust)
+  {
+    double derivative;
+    for(std::size_t i=0;i<n;++i)
+    {
+      residual[i] = robust_residual(huber, loss_scale_, residual[i], derivative);
+      if(grad)
+      {
+        for(int k=0;k<11;++k)
+          grad[k * n + i] *= derivative;
+      }
+    }
+  }
+}
+
+template<typename PointType>
+double SuperquadricFittingT<PointType>::OptimizationFunctor::normalEquations(const Vector11d &xvec, Matrix11d *JtJ,
+                                                                              Vector11d *Jtr) const
+{
+  const bool jacobian = JtJ != NULL;
+  sq::Arena::Scope scope(*arena_);
+  const std::size_t n_chunks = sq::ThreadPool::chunkCount(values(), sq::SQ_POINT_CHUNK_SIZE);
+  NormalEquations* sums = arena_->allocate<NormalEquations>(n_chunks);
+  sq::ThreadPool::instance().runChunks(values(), sq::SQ_POINT_CHUNK_SIZE, estimator_->parallel_threshold_,
+                                       [&](std::size_t chunk, std::size_t begin, std::size_t end)
+  {
+    accumulate(xvec, begin, end, jacobian, sums[chunk]);
+  });
+  for(std::size_t i=1;i<n_chunks;++i)
+  {
+    sums[0].cost += sums[i].cost;
+    if(jacobian)
+    {
+      sums[0].JtJ += sums[i].JtJ;
+      sums[0].Jtr += sums[i].Jtr;
+    }
+  }
+  if(jacobian)
+  {
+    *JtJ = sums[0].JtJ.template selfadjointView<Eigen::Lower>();
+    *Jtr = sums[0].Jtr;
+  }
+  return sums[0].cost;
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::OptimizationFunctor::accumulate(const Vector11d &xvec, const std::size_t begin,
+                                                                      const std::size_t end, const bool jacobian,
+                                                                      NormalEquations &sums) const
+{
+  sums.JtJ.setZero();
+  sums.Jtr.setZero();
+  sums.cost = 0;
+  sq::SQKernelParam param;
+  sq::create_kernel_param(xvec, param);
+  param.accuracy = estimator_->kernel_accuracy_;
+  if(!jacobian && estimator_->loss_ == LOSS_SQUARED)
+  {
+    if(points_f_)
+    {
+      const sq::PointBufferf& points = *points_f_;
+      sums.cost = sq::sq_batch_squared_error(points.x.data() + begin, points.y.data() + begin,
+                                             points.z.data() + begin, end - begin, param);
+    }
+    else
+    {
+      const sq::PointBuffer& points = *points_;
+      sums.cost = sq::sq_batch_squared_error(points.x.data() + begin, points.y.data() + begin,
+                                             points.z.data() + begin, end - begin, param);
+    }
+    if(normals_)
+      accumulateNormals(xvec, begin, end, jacobian, sums);
+    return;
+  }
+
+  //the residuals and the gradient of a block, as structure of arrays, stay in the l1 cache
+  double residual[BLOCK_SIZE];
+  double grad[sq::SQ_KERNEL_GRAD_SIZE * BLOCK_SIZE];
+  for(std::size_t b=begin;b<end;b+=BLOCK_SIZE)
+  {
+    const std::size_t n = std::min<std::size_t>(BLOCK_SIZE, end - b);
+    evaluate(xvec, param, b, n, residual, jacobian ? grad : NULL);
+    Eigen::Map<Eigen::VectorXd> r(residual, n);
+    sums.cost += r.squaredNorm();
+    if(jacobian)
+    {
+      Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 11> > J(grad, n, 11);
+      sums.JtJ.template selfadjointView<Eigen::Lower>().rankUpdate(J.transpose());
+      sums.Jtr.noalias() += J.transpose() * r;
+    }
+  }
+  if(normals_)
+    accumulateNormals(xvec, begin, end, jacobian, sums);
+}
+
+template<typename PointType>
+void SuperquadricFittingT<PointType>::OptimizationFunctor::accumulateNormals(const Vector11d &xvec, const std::size_t begin,
+                                                                             const std::size_t end, const bool jacobian,
+                                                                             NormalEquations &sums) const
+{
+  //scaled by (a1*a2*a3)^0.25 like the radial residuals
+  const double weight = estimator_->normal_weight_ * pow(std::abs(xvec[0] * xvec[1] * xvec[2]), 0.25);
+  const sq::PointBuffer& points = *points_;
+  const sq::PointBuffer& normals = *normals_;
+  sq::SQJet jet[11];
+  Eigen::Matrix<sq::SQJet, 3, 3> rotation;
+  if(jacobian)
+  {
+    for(int j=0;j<11;++j)
+      jet[j] = sq::SQJet(xvec[j], 11, j);
+    if(estimator_->localRotation())
+    {
+      //derivatives w.r.t. a rotation vector on the left of the rotation, at zero
+      Eigen::Affine3d r0;
+      sq::create_rotation_matrix(xvec[8], xvec[9], xvec[10], r0);
+      Eigen::Matrix<sq::SQJet, 3, 3> skew;
+      skew << sq::SQJet(1.), -sq::SQJet(0., 11, 10), sq::SQJet(0., 11, 9),
+              sq::SQJet(0., 11, 10), sq::SQJet(1.), -sq::SQJet(0., 11, 8),
+              -sq::SQJet(0., 11, 9), sq::SQJet(0., 11, 8), sq::SQJet(1.);
+      rotation = skew * r0.linear().cast<sq::SQJet>();
+    }
+    else
+    {
+      const sq::SQJet sx = sin(jet[8]), cx = cos(jet[8]);
+      const sq::SQJet sy = sin(jet[9]), cy = cos(jet[9]);
+      const sq::SQJet sz = sin(jet[10]), cz = cos(jet[10]);
+      Eigen::Matrix<sq::SQJet, 3, 3> rx, ry, rz;
+      rx << sq::SQJet(1.), sq::SQJet(0.), sq::SQJet(0.), sq::SQJet(0.), cx, -sx, sq::SQJet(0.), sx, cx;
+      ry << cy, sq::SQJet(0.), sy, sq::SQJet(0.), sq::SQJet(1.), sq::SQJet(0.), -sy, sq::SQJet(0.), cy;
+      rz << cz, -sz, sq::SQJet(0.), sz, cz, sq::SQJet(0.), sq::SQJet(0.), sq::SQJet(0.), sq::SQJet(1.);
+      rotation = rx * rz * ry;
+    }
+  }
+  //derivatives of the scale w.r.t. the sizes
+  const Eigen::Vector3d weight_grad = 0.25 * weight * Eigen::Vector3d(1. / xvec[0], 1. / xvec[1], 1. / xvec[2]);
+  Eigen::Affine3d r0;
+  sq::create_rotation_matrix(xvec[8], xvec[9], xvec[10], r0);
+  const Eigen::Matrix3d rotation_d = r0.linear();
+  Eigen::Matrix<double, 3, 11> J;
+  for(std::size_t i=begin;i<end;++i)
+  {
+    const Eigen::Vector3d n(normals.x[i], normals.y[i], normals.z[i]);
+    if(n.isZero())
+      continue;
+    const Eigen::Vector3d p(points.x[i], points.y[i], points.z[i]);
+    Eigen::Vector3d r;
+    if(jacobian)
+    {
+      sq::SQJet residual[3];
+      sq::sq_normal_residual(jet, rotation, p, n, residual);
+      for(int k=0;k<3;++k)
+      {
+        r(k) = weight * residual[k].value();
+        J.row(k) = weight * residual[k].derivatives().transpose();
+        J.row(k).head<3>() += residual[k].value() * weight_grad.transpose();
+      }
+      sums.JtJ.template selfadjointView<Eigen::Lower>().rankUpdate(J.transpose());
+      sums.Jtr.noalias() += J.transpose() * r;
+    }
+    else
+    {
+      sq::sq_normal_residual(xvec.data(), rotation_d, p, n, r.data());
+      r *= weight;
+    }
+    sums.cost += r.squaredNorm();
+  }
+}
+
+template class SuperquadricFittingT<pcl::PointXYZ>;
+template class SuperquadricFittingT<pcl::PointXYZRGB>;
+template class SuperquadricFittingT<pcl::PointNormal>;
@@ -0,0 +1,96 @@
+#include <sq_fitting/fitting_context.h>
+#include <algorithm>
+#include <cstdint>
+
+namespace sq {
+
+Arena::Arena(const std::size_t capacity) : block_(0), offset_(0), initial_capacity_(capacity)
+{
+}
+
+/**
+ * @brief first aligned byte of a block, blocks are allocated with alignment bytes to spare
+ */
+static char* alignedBase(char* block, const std::size_t alignment)
+{
+  const std::size_t misalignment = reinterpret_cast<std::uintptr_t>(block) % alignment;
+  return misalignment == 0 ? block : block + alignment - misalignment;
+}
+
+void* Arena::allocateBytes(std::size_t bytes)
+{
+  //sizes are rounded so that every offset stays aligned
+  bytes = (std::max<std::size_t>(bytes, 1) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  while(block_ < blocks_.size() && offset_ + bytes > sizes_[block_])
+  {
+    ++block_;
+    offset_ = 0;
+  }
+  if(block_ == blocks_.size())
+  {
+    //every new block at least doubles the capacity
+    const std::size_t size = std::max(bytes, std::max(capacity(), initial_capacity_));
+    blocks_.push_back(std::unique_ptr<char[]>(new char[size + ALIGNMENT]));
+    sizes_.push_back(size);
+    offset_ = 0;
+  }
+  void* p = alignedBase(blocks_[block_].get(), ALIGNMENT) + offset_;
+  offset_ += bytes;
+  return p;
+}
+
+Arena::Marker Arena::mark() const
+{
+  Marker marker;
+  marker.block = block_;
+  marker.offset = offset_;
+  return marker;
+}
+
+void Arena::rewind(const Marker &marker)
+{
+  block_ = marker.block;
+  offset_ = marker.offset;
+}
+
+void Arena::reset()
+{
+  if(blocks_.size() > 1)
+  {
+    const std::size_t size = capacity();
+    blocks_.clear();
+    sizes_.clear();
+    blocks_.push_back(std::unique_ptr<char[]>(new char[size + ALIGNMENT]));
+    sizes_.push_back(size);
+  }
+  block_ = 0;
+  offset_ = 0;
+}
+
+std::size_t Arena::capacity() const
+{
+  std::size_t size = 0;
+  for(std::size_t i=0;i<sizes_.size();++i)
+    size += sizes_[i];
+  return size;
+}
+
+FittingContext::FittingContext()
+{
+}
+
+FittingContext& FittingContext::hypothesis(const std::size_t i)
+{
+  while(hypotheses_.size() <= i)
+    hypotheses_.push_back(std::unique_ptr<FittingContext>(new FittingContext));
+  return *hypotheses_[i];
+}
+
+void FittingContext::reset()
+{
+  arena.reset();
+  for(std::size_t i=0;i<hypotheses_.size();++i)
+    hypotheses_[i]->reset();
+}
+
+}//end of namespace
@@ -0,0 +1,219 @@
+#include <sq_fitting/kernel.h>
+#include "kernel_impl.h"
+#include <atomic>
+
+namespace {
+
+template<typename TT>
+struct ScalarTraits
+{
+  typedef TT T;
+  typedef TT V;
+  typedef bool M;
+  enum { W = 1 };
+
+  static V load(const T* p) { return *p; }
+  static void store(T* p, V v) { *p = v; }
+  static V set1(T v) { return v; }
+  static V add(V a, V b) { return a + b; }
+  static V sub(V a, V b) { return a - b; }
+  static V mul(V a, V b) { return a * b; }
+  static V div(V a, V b) { return a / b; }
+  static V fmadd(V a, V b, V c) { return a * b + c; }
+  static V sqrt(V a) { return std::sqrt(a); }
+  static V abs(V a) { return std::abs(a); }
+  static V min(V a, V b) { return a < b ? a : b; }
+  static V max(V a, V b) { return a > b ? a : b; }
+  static M gt(V a, V b) { return a > b; }
+  static M lt(V a, V b) { return a < b; }
+  static M neq(V a, V b) { return a != b; }
+  static V select(M m, V a, V b) { return m ? a : b; }
+  static V log(V x) { return std::log(x); }
+  static V exp(V x) { return std::exp(x); }
+  static V round(V a) { return std::floor(a + static_cast<T>(0.5)); }
+  static V frexp(V x, V& e)
+  {
+    int k;
+    V m = std::frexp(x, &k);
+    e = static_cast<T>(k);
+    return m;
+  }
+  static V pow2n(V n) { return std::ldexp(static_cast<T>(1.0), static_cast<int>(n)); }
+};
+
+void evaluate_scalar_d(const double* x, const double* y, const double* z, const std::size_t n, const sq::SQKernelParam& param,
+                       const sq::KernelAccuracy accuracy, double* inside_outside,
+                       double* residual, double* grad, double* squared_sum)
+{
+  sq_kernel_evaluate<ScalarTraits<double> >(x, y, z, n, param, accuracy, inside_outside, residual, grad, squared_sum);
+}
+
+void evaluate_scalar_f(const float* x, const float* y, const float* z, const std::size_t n, const sq::SQKernelParam& param,
+                       const sq::KernelAccuracy accuracy, float* inside_outside,
+                       float* residual, float* grad, double* squared_sum)
+{
+  sq_kernel_evaluate<ScalarTraits<float> >(x, y, z, n, param, accuracy, inside_outside, residual, grad, squared_sum);
+}
+
+struct KernelTable
+{
+  sq::KernelType type;
+  sq::detail::KernelEvaluateD evaluate_d;
+  sq::detail::KernelEvaluateF evaluate_f;
+};
+
+bool cpu_supports(const sq::KernelType type)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  if(type == sq::KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if(type == sq::KERNEL_SSE2)
+    return __builtin_cpu_supports("sse2");
+  return true;
+#else
+  return type == sq::KERNEL_SCALAR;
+#endif
+}
+
+bool select_kernel(const sq::KernelType type, KernelTable& table)
+{
+  if(!cpu_supports(type))
+    return false;
+  sq::detail::KernelEvaluateD evaluate_d;
+  sq::detail::KernelEvaluateF evaluate_f;
+  bool compiled = true;
+  if(type == sq::KERNEL_AVX2)
+    compiled = sq::detail::kernel_avx2_functions(evaluate_d, evaluate_f);
+  else if(type == sq::KERNEL_SSE2)
+    compiled = sq::detail::kernel_sse2_functions(evaluate_d, evaluate_f);
+  else
+  {
+    evaluate_d = &evaluate_scalar_d;
+    evaluate_f = &evaluate_scalar_f;
+  }
+  if(!compiled)
+    return false;
+  table.type = type;
+  table.evaluate_d = evaluate_d;
+  table.evaluate_f = evaluate_f;
+  return true;
+}
+
+KernelTable detect_kernel()
+{
+  KernelTable table;
+  if(!select_kernel(sq::KERNEL_AVX2, table))
+    if(!select_kernel(sq::KERNEL_SSE2, table))
+      select_kernel(sq::KERNEL_SCALAR, table);
+  return table;
+}
+
+KernelTable& kernel_table()
+{
+  static KernelTable table = detect_kernel();
+  return table;
+}
+
+std::atomic<sq::KernelAccuracy>& default_accuracy()
+{
+  static std::atomic<sq::KernelAccuracy> accuracy(sq::ACCURACY_FULL);
+  return accuracy;
+}
+
+}//end of anonymous namespace
+
+namespace sq {
+
+void sq_kernel_param(const double a1, const double a2, const double a3, const double e1, const double e2,
+                     SQKernelParam& param)
+{
+  param.a1 = a1;
+  param.a2 = a2;
+  param.a3 = a3;
+  param.e1 = e1;
+  param.e2 = e2;
+  for(int i=0;i<12;++i)
+    param.transform[i] = (i % 5 == 0) ? 1.0 : 0.0;
+  param.accuracy = default_accuracy();
+}
+
+void sq_kernel_set_transform(const double* rotation, const double* translation, SQKernelParam& param)
+{
+  for(int r=0;r<3;++r)
+  {
+    for(int c=0;c<3;++c)
+      param.transform[4*r+c] = rotation[3*c+r];
+    param.transform[4*r+3] = translation[r];
+  }
+}
+
+void sq_batch_inside_outside(const double* x, const double* y, const double* z, const std::size_t n,
+                             const SQKernelParam& param, double* inside_outside)
+{
+  kernel_table().evaluate_d(x, y, z, n, param, param.accuracy, inside_outside, NULL, NULL, NULL);
+}
+
+void sq_batch_inside_outside(const float* x, const float* y, const float* z, const std::size_t n,
+                             const SQKernelParam& param, float* inside_outside)
+{
+  kernel_table().evaluate_f(x, y, z, n, param, param.accuracy, inside_outside, NULL, NULL, NULL);
+}
+
+void sq_batch_radial_residual(const double* x, const double* y, const double* z, const std::size_t n,
+                              const SQKernelParam& param, double* residual, double* grad)
+{
+  kernel_table().evaluate_d(x, y, z, n, param, param.accuracy, NULL, residual, grad, NULL);
+}
+
+void sq_batch_radial_residual(const float* x, const float* y, const float* z, const std::size_t n,
+                              const SQKernelParam& param, float* residual, float* grad)
+{
+  kernel_table().evaluate_f(x, y, z, n, param, param.accuracy, NULL, residual, grad, NULL);
+}
+
+double sq_batch_squared_error(const double* x, const double* y, const double* z, const std::size_t n,
+                              const SQKernelParam& param)
+{
+  double sum = 0.0;
+  kernel_table().evaluate_d(x, y, z, n, param, param.accuracy, NULL, NULL, NULL, &sum);
+  return sum;
+}
+
+double sq_batch_squared_error(const float* x, const float* y, const float* z, const std::size_t n,
+                              const SQKernelParam& param)
+{
+  double sum = 0.0;
+  kernel_table().evaluate_f(x, y, z, n, param, param.accuracy, NULL, NULL, NULL, &sum);
+  return sum;
+}
+
+KernelType sq_kernel_type()
+{
+  return kernel_table().type;
+}
+
+bool sq_set_kernel_type(const KernelType type)
+{
+  return select_kernel(type, kernel_table());
+}
+
+KernelAccuracy sq_kernel_accuracy()
+{
+  return default_accuracy();
+}
+
+void sq_set_kernel_accuracy(const KernelAccuracy accuracy)
+{
+  default_accuracy() = accuracy;
+}
+
+double sq_kernel_pow(const double x, const double p)
+{
+  typedef ScalarTraits<double> Tr;
+  const KernelMath<Tr> math(default_accuracy());
+  const PowCase pow = pow_case(p);
+  const double ax = std::abs(x);
+  return kernel_pow<Tr>(math, pow, ax, ax > 0.0, p, pow == POW_GENERAL ? math.log(ax) : 0.0);
+}
+
+}//end of namespace
@@ -0,0 +1,131 @@
+#include "kernel_impl.h"
+
+// Compiled with -mavx2 -mfma, only called after the runtime check in kernel.cpp
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Double
+{
+  typedef double T;
+  typedef __m256d V;
+  typedef __m256d M;
+  enum { W = 4 };
+
+  static V load(const T* p) { return _mm256_loadu_pd(p); }
+  static void store(T* p, V v) { _mm256_storeu_pd(p, v); }
+  static V set1(T v) { return _mm256_set1_pd(v); }
+  static V add(V a, V b) { return _mm256_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm256_div_pd(a, b); }
+  static V fmadd(V a, V b, V c) { return _mm256_fmadd_pd(a, b, c); }
+  static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+  static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+  static V min(V a, V b) { return _mm256_min_pd(a, b); }
+  static V max(V a, V b) { return _mm256_max_pd(a, b); }
+  static V round(V a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static M gt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static M neq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_OQ); }
+  static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+
+  //mantissa in [0.5, 1) and exponent of x > 0
+  static V frexp(V x, V& e)
+  {
+    const __m256i bits = _mm256_castpd_si256(x);
+    const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+    __m256i biased = _mm256_srli_epi64(bits, 52);
+    e = _mm256_sub_pd(_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(biased, _mm256_castpd_si256(magic))), magic),
+                      _mm256_set1_pd(1022.0));
+    __m256i mantissa = _mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL));
+    return _mm256_castsi256_pd(_mm256_or_si256(mantissa, _mm256_set1_epi64x(0x3FE0000000000000LL)));
+  }
+
+  //2^n for integral n in [-1022, 1023]
+  static V pow2n(V n)
+  {
+    __m256d biased = _mm256_add_pd(n, _mm256_set1_pd(4503599627370496.0 + 1023.0));
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(biased), 52));
+  }
+
+  static V log(V x) { return cephes_log_d<Avx2Double>(x); }
+  static V exp(V x) { return cephes_exp_d<Avx2Double>(x); }
+};
+
+struct Avx2Float
+{
+  typedef float T;
+  typedef __m256 V;
+  typedef __m256 M;
+  enum { W = 8 };
+
+  static V load(const T* p) { return _mm256_loadu_ps(p); }
+  static void store(T* p, V v) { _mm256_storeu_ps(p, v); }
+  static V set1(T v) { return _mm256_set1_ps(v); }
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static V div(V a, V b) { return _mm256_div_ps(a, b); }
+  static V fmadd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+  static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+  static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+  static V min(V a, V b) { return _mm256_min_ps(a, b); }
+  static V max(V a, V b) { return _mm256_max_ps(a, b); }
+  static V round(V a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static M gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static M lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static M neq(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ); }
+  static V select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+
+  static V frexp(V x, V& e)
+  {
+    const __m256i bits = _mm256_castps_si256(x);
+    e = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 23)), _mm256_set1_ps(126.0f));
+    __m256i mantissa = _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF));
+    return _mm256_castsi256_ps(_mm256_or_si256(mantissa, _mm256_set1_epi32(0x3F000000)));
+  }
+
+  static V pow2n(V n)
+  {
+    __m256i biased = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(biased, 23));
+  }
+
+  static V log(V x) { return cephes_log_f<Avx2Float>(x); }
+  static V exp(V x) { return cephes_exp_f<Avx2Float>(x); }
+};
+
+void evaluate_avx2_d(const double* x, const double* y, const double* z, const std::size_t n, const sq::SQKernelParam& param,
+                     const sq::KernelAccuracy accuracy, double* inside_outside,
+                     double* residual, double* grad, double* squared_sum)
+{
+  sq_kernel_evaluate<Avx2Double>(x, y, z, n, param, accuracy, inside_outside, residual, grad, squared_sum);
+}
+
+void evaluate_avx2_f(const float* x, const float* y, const float* z, const std::size_t n, const sq::SQKernelParam& param,
+                     const sq::KernelAccuracy accuracy, float* inside_outside,
+                     float* residual, float* grad, double* squared_sum)
+{
+  sq_kernel_evaluate<Avx2Float>(x, y, z, n, param, accuracy, inside_outside, residual, grad, squared_sum);
+}
+
+}//end of anonymous namespace
+
+bool sq::detail::kernel_avx2_functions(KernelEvaluateD& evaluate_d, KernelEvaluateF& evaluate_f)
+{
+  evaluate_d = &evaluate_avx2_d;
+  evaluate_f = &evaluate_avx2_f;
+  return true;
+}
+
+#else
+
+bool sq::detail::kernel_avx2_functions(KernelEvaluateD& evaluate_d, KernelEvaluateF& evaluate_f)
+{
+  return false;
+}
+
+#endif
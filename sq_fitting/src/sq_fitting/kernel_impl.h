@@ -0,0 +1,461 @@
+#ifndef KERNEL_IMPL_H
+#define KERNEL_IMPL_H
+
+// Body of the superquadric batch kernels, written once against a small vector traits
+// interface (Tr) and included by one translation unit per instruction set.
+// Everything is kept in an anonymous namespace so the copies compiled with different
+// instruction set flags never get merged by the linker.
+
+#include <sq_fitting/kernel.h>
+#include <cstring>
+#include <cmath>
+
+namespace sq {
+namespace detail {
+
+typedef void (*KernelEvaluateD)(const double*, const double*, const double*, const std::size_t, const SQKernelParam&,
+                                const KernelAccuracy, double*, double*, double*, double*);
+typedef void (*KernelEvaluateF)(const float*, const float*, const float*, const std::size_t, const SQKernelParam&,
+                                const KernelAccuracy, float*, float*, float*, double*);
+
+/**
+ * Each instruction set translation unit reports its kernels, false if it was not
+ * compiled with the needed instruction set
+ */
+bool kernel_sse2_functions(KernelEvaluateD& evaluate_d, KernelEvaluateF& evaluate_f);
+bool kernel_avx2_functions(KernelEvaluateD& evaluate_d, KernelEvaluateF& evaluate_f);
+
+}//end of namespace detail
+}//end of namespace sq
+
+namespace {
+
+template<typename T> inline T kernel_min(T a, T b) { return a < b ? a : b; }
+
+template<class Tr>
+inline typename Tr::V poly_eval(typename Tr::V x, const double* c, const int n)
+{
+  typedef typename Tr::T T;
+  typename Tr::V y = Tr::set1(static_cast<T>(c[0]));
+  for(int i=1;i<n;++i)
+    y = Tr::fmadd(y, x, Tr::set1(static_cast<T>(c[i])));
+  return y;
+}
+
+/**
+ * natural logarithm for x > 0 in double precision (cephes log)
+ */
+template<class Tr>
+inline typename Tr::V cephes_log_d(typename Tr::V x)
+{
+  typedef typename Tr::V V;
+  static const double P[] = {1.01875663804580931796E-4, 4.97494994976747001425E-1, 4.70579119878881725854E0,
+                             1.44989225341610930846E1, 1.79368678507819816313E1, 7.70838733755885391666E0};
+  static const double Q[] = {1.0, 1.12873587189167450590E1, 4.52279145837532221105E1, 8.29875266912776603211E1,
+                             7.11544750618563894466E1, 2.31251620126765340583E1};
+  V e;
+  V m = Tr::frexp(x, e);
+  typename Tr::M small = Tr::lt(m, Tr::set1(0.70710678118654752440));
+  e = Tr::sub(e, Tr::select(small, Tr::set1(1.0), Tr::set1(0.0)));
+  m = Tr::sub(Tr::select(small, Tr::add(m, m), m), Tr::set1(1.0));
+  V z = Tr::mul(m, m);
+  V y = Tr::mul(m, Tr::div(Tr::mul(z, poly_eval<Tr>(m, P, 6)), poly_eval<Tr>(m, Q, 6)));
+  y = Tr::fmadd(e, Tr::set1(-2.121944400546905827679e-4), y);
+  y = Tr::fmadd(z, Tr::set1(-0.5), y);
+  V r = Tr::add(m, y);
+  return Tr::fmadd(e, Tr::set1(0.693359375), r);
+}
+
+/**
+ * exponential in double precision (cephes exp), the argument is clamped to +-700
+ */
+template<class Tr>
+inline typename Tr::V cephes_exp_d(typename Tr::V x)
+{
+  typedef typename Tr::V V;
+  static const double P[] = {1.26177193074810590878E-4, 3.02994407707441961300E-2, 9.99999999999999999910E-1};
+  static const double Q[] = {3.00198505138664455042E-6, 2.52448340349684104192E-3, 2.27265548208155028766E-1,
+                             2.00000000000000000009E0};
+  x = Tr::max(Tr::min(x, Tr::set1(700.0)), Tr::set1(-700.0));
+  V n = Tr::round(Tr::mul(x, Tr::set1(1.4426950408889634073599)));
+  x = Tr::fmadd(n, Tr::set1(-6.93145751953125E-1), x);
+  x = Tr::fmadd(n, Tr::set1(-1.42860682030941723212E-6), x);
+  V xx = Tr::mul(x, x);
+  V px = Tr::mul(x, poly_eval<Tr>(xx, P, 3));
+  x = Tr::div(px, Tr::sub(poly_eval<Tr>(xx, Q, 4), px));
+  x = Tr::fmadd(x, Tr::set1(2.0), Tr::set1(1.0));
+  return Tr::mul(x, Tr::pow2n(n));
+}
+
+/**
+ * natural logarithm for x > 0 in single precision (cephes logf)
+ */
+template<class Tr>
+inline typename Tr::V cephes_log_f(typename Tr::V x)
+{
+  typedef typename Tr::V V;
+  static const double P[] = {7.0376836292E-2, -1.1514610310E-1, 1.1676998740E-1, -1.2420140846E-1,
+                             1.4249322787E-1, -1.6668057665E-1, 2.0000714765E-1, -2.4999993993E-1,
+                             3.3333331174E-1};
+  V e;
+  V m = Tr::frexp(x, e);
+  typename Tr::M small = Tr::lt(m, Tr::set1(0.707106781186547524f));
+  e = Tr::sub(e, Tr::select(small, Tr::set1(1.0f), Tr::set1(0.0f)));
+  m = Tr::sub(Tr::select(small, Tr::add(m, m), m), Tr::set1(1.0f));
+  V z = Tr::mul(m, m);
+  V y = Tr::mul(Tr::mul(poly_eval<Tr>(m, P, 9), m), z);
+  y = Tr::fmadd(e, Tr::set1(-2.12194440e-4f), y);
+  y = Tr::fmadd(z, Tr::set1(-0.5f), y);
+  V r = Tr::add(m, y);
+  return Tr::fmadd(e, Tr::set1(0.693359375f), r);
+}
+
+/**
+ * exponential in single precision (cephes expf), the argument is clamped to +-80
+ */
+template<class Tr>
+inline typename Tr::V cephes_exp_f(typename Tr::V x)
+{
+  typedef typename Tr::V V;
+  static const double P[] = {1.9875691500E-4, 1.3981999507E-3, 8.3334519073E-3, 4.1665795894E-2,
+                             1.6666665459E-1, 5.0000001201E-1};
+  x = Tr::max(Tr::min(x, Tr::set1(80.0f)), Tr::set1(-80.0f));
+  V n = Tr::round(Tr::mul(x, Tr::set1(1.44269504088896341f)));
+  x = Tr::fmadd(n, Tr::set1(-0.693359375f), x);
+  x = Tr::fmadd(n, Tr::set1(2.12194440e-4f), x);
+  V z = Tr::mul(x, x);
+  V y = Tr::fmadd(poly_eval<Tr>(x, P, 6), z, Tr::add(x, Tr::set1(1.0f)));
+  return Tr::mul(y, Tr::pow2n(n));
+}
+
+/**
+ * log2(m) = s * R(s^2) with s = (m - 1) / (m + 1) for m in [sqrt(0.5), sqrt(2)), R interpolated
+ * at Chebyshev nodes. Absolute error 1.2e-5 (FAST) and 3.5e-10 (HIGH)
+ */
+const double LOG2_FAST[] = {9.79103089651200298e-01, 2.88532623205213623e+00};
+const double LOG2_HIGH[] = {4.31717697442109971e-01, 5.76715186017448422e-01, 9.61798838802188860e-01,
+                            2.88539007980333606e+00};
+
+/**
+ * 2^f for f in [-0.5, 0.5] interpolated at Chebyshev nodes. Relative error 3.5e-6 (FAST) and
+ * 2.6e-9 (HIGH)
+ */
+const double EXP2_FAST[] = {9.66636851538746865e-03, 5.59219758422562635e-02, 2.40223490380203353e-01,
+                            6.93121045203426989e-01, 9.99999999999999778e-01};
+const double EXP2_HIGH[] = {1.54614446956325731e-04, 1.34004281774160929e-03, 9.61805667853236033e-03,
+                            5.55032722667084602e-02, 2.40226509222887297e-01, 6.93147206702832364e-01,
+                            1.00000000000000000e+00};
+
+/**
+ * log2 for x > 0 from the exponent and a polynomial of the mantissa
+ */
+template<class Tr>
+inline typename Tr::V fast_log2(typename Tr::V x, const double* c, const int n)
+{
+  typedef typename Tr::T T;
+  typedef typename Tr::V V;
+  const V one = Tr::set1(static_cast<T>(1.0));
+  V e;
+  V m = Tr::frexp(x, e);
+  typename Tr::M small = Tr::lt(m, Tr::set1(static_cast<T>(0.70710678118654752440)));
+  e = Tr::sub(e, Tr::select(small, one, Tr::set1(static_cast<T>(0.0))));
+  m = Tr::select(small, Tr::add(m, m), m);
+  V s = Tr::div(Tr::sub(m, one), Tr::add(m, one));
+  return Tr::fmadd(s, poly_eval<Tr>(Tr::mul(s, s), c, n), e);
+}
+
+/**
+ * 2^x from the integral part and a polynomial of the fraction, the argument is clamped to
+ * the normal range of T
+ */
+template<class Tr>
+inline typename Tr::V fast_exp2(typename Tr::V x, const double* c, const int n)
+{
+  typedef typename Tr::T T;
+  typedef typename Tr::V V;
+  const T limit = sizeof(T) == sizeof(float) ? 126 : 1022;
+  x = Tr::max(Tr::min(x, Tr::set1(limit)), Tr::set1(-limit));
+  V k = Tr::round(x);
+  return Tr::mul(poly_eval<Tr>(Tr::sub(x, k), c, n), Tr::pow2n(k));
+}
+
+/**
+ * natural logarithm and exponential of the batch kernels, the cephes functions of the traits
+ * or the log2 and exp2 polynomials of the accuracy
+ */
+template<class Tr>
+struct KernelMath
+{
+  typedef typename Tr::T T;
+  typedef typename Tr::V V;
+
+  explicit KernelMath(const sq::KernelAccuracy accuracy)
+    : full(accuracy == sq::ACCURACY_FULL),
+      log2_coefficients(accuracy == sq::ACCURACY_FAST ? LOG2_FAST : LOG2_HIGH),
+      log2_terms(accuracy == sq::ACCURACY_FAST ? 2 : 4),
+      exp2_coefficients(accuracy == sq::ACCURACY_FAST ? EXP2_FAST : EXP2_HIGH),
+      exp2_terms(accuracy == sq::ACCURACY_FAST ? 5 : 7)
+  {
+  }
+
+  V log(V x) const
+  {
+    if(full)
+      return Tr::log(x);
+    return Tr::mul(fast_log2<Tr>(x, log2_coefficients, log2_terms), Tr::set1(static_cast<T>(0.69314718055994530942)));
+  }
+
+  V exp(V x) const
+  {
+    if(full)
+      return Tr::exp(x);
+    return fast_exp2<Tr>(Tr::mul(x, Tr::set1(static_cast<T>(1.4426950408889634074))), exp2_coefficients, exp2_terms);
+  }
+
+  bool full;
+  const double* log2_coefficients;
+  int log2_terms;
+  const double* exp2_coefficients;
+  int exp2_terms;
+};
+
+/**
+ * exponents evaluated without log and exp, they are uniform over a batch
+ */
+enum PowCase { POW_GENERAL = 0, POW_HALF, POW_ONE, POW_TWO };
+
+inline PowCase pow_case(const double p)
+{
+  if(p == 1.0)
+    return POW_ONE;
+  if(p == 2.0)
+    return POW_TWO;
+  if(p == 0.5)
+    return POW_HALF;
+  return POW_GENERAL;
+}
+
+/**
+ * x^p for x >= 0, 0 at x = 0
+ * @param x_pos x > 0
+ * @param log_x log(x), only read by POW_GENERAL
+ */
+template<class Tr>
+inline typename Tr::V kernel_pow(const KernelMath<Tr>& math, const PowCase pow, typename Tr::V x,
+                                 typename Tr::M x_pos, typename Tr::V p, typename Tr::V log_x)
+{
+  switch(pow)
+  {
+  case POW_ONE:
+    return x;
+  case POW_TWO:
+    return Tr::mul(x, x);
+  case POW_HALF:
+    return Tr::sqrt(x);
+  default:
+    return Tr::select(x_pos, math.exp(Tr::mul(p, log_x)), Tr::set1(static_cast<typename Tr::T>(0.0)));
+  }
+}
+
+template<class Tr>
+inline void kernel_store(typename Tr::T* dst, typename Tr::V v, const std::size_t m)
+{
+  if(m == static_cast<std::size_t>(Tr::W))
+    Tr::store(dst, v);
+  else
+  {
+    typename Tr::T tmp[Tr::W];
+    Tr::store(tmp, v);
+    std::memcpy(dst, tmp, m * sizeof(typename Tr::T));
+  }
+}
+
+/**
+ * Evaluates the superquadric on n points. Every output pointer can be NULL.
+ * @param accuracy of the powers, see KernelAccuracy
+ * @param inside_outside inside-outside function, n values
+ * @param residual radial residual, n values
+ * @param grad gradient of the radial residual, SQ_KERNEL_GRAD_SIZE * n values
+ * @param squared_sum sum of squared radial residuals
+ */
+template<class Tr>
+void sq_kernel_evaluate(const typename Tr::T* x, const typename Tr::T* y, const typename Tr::T* z, const std::size_t n,
+                        const sq::SQKernelParam& param, const sq::KernelAccuracy accuracy, typename Tr::T* inside_outside, typename Tr::T* residual,
+                        typename Tr::T* grad, double* squared_sum)
+{
+  typedef typename Tr::T T;
+  typedef typename Tr::V V;
+  typedef typename Tr::M M;
+  const int W = Tr::W;
+
+  double e1 = param.e1 < 0.1 ? 0.1 : (param.e1 > 1.9 ? 1.9 : param.e1);
+  double e2 = param.e2 < 0.1 ? 0.1 : (param.e2 > 1.9 ? 1.9 : param.e2);
+  const bool e1_free = (e1 == param.e1);
+  const bool e2_free = (e2 == param.e2);
+
+  V rot[9], trans[3];
+  for(int r=0;r<3;++r)
+  {
+    for(int c=0;c<3;++c)
+      rot[3*r+c] = Tr::set1(static_cast<T>(param.transform[4*r+c]));
+    trans[r] = Tr::set1(static_cast<T>(param.transform[4*r+3]));
+  }
+  const V zero = Tr::set1(static_cast<T>(0.0));
+  const V one = Tr::set1(static_cast<T>(1.0));
+  const V inv_a = Tr::set1(static_cast<T>(1.0 / param.a1));
+  const V inv_b = Tr::set1(static_cast<T>(1.0 / param.a2));
+  const V inv_c = Tr::set1(static_cast<T>(1.0 / param.a3));
+  const V p2e2 = Tr::set1(static_cast<T>(2.0 / e2));
+  const V p2e1 = Tr::set1(static_cast<T>(2.0 / e1));
+  const V qe = Tr::set1(static_cast<T>(e2 / e1));
+  const V he1 = Tr::set1(static_cast<T>(e1 / 2.0));
+  const V s = Tr::set1(static_cast<T>(pow(param.a1 * param.a2 * param.a3, 0.25)));
+  const V quarter = Tr::set1(static_cast<T>(0.25));
+  const V de2_scale = Tr::set1(static_cast<T>(e2_free ? -2.0 / (e2 * e2) : 0.0));
+  const V de2_g = Tr::set1(static_cast<T>(e2_free ? 1.0 / e1 : 0.0));
+  const V de1_g = Tr::set1(static_cast<T>(e1_free ? -e2 / (e1 * e1) : 0.0));
+  const V de1_t3 = Tr::set1(static_cast<T>(e1_free ? -2.0 / (e1 * e1) : 0.0));
+  const V de1_fp = Tr::set1(static_cast<T>(e1_free ? 0.5 : 0.0));
+
+  //the logs are only needed by general exponents and the derivatives w.r.t. free e1 or e2
+  const KernelMath<Tr> math(accuracy);
+  const PowCase pow_xy = pow_case(2.0 / e2);
+  const PowCase pow_z = pow_case(2.0 / e1);
+  const PowCase pow_u = pow_case(e2 / e1);
+  const PowCase pow_f = pow_case(e1 / 2.0);
+  const bool shape_logs = (grad != NULL && (e1_free || e2_free));
+  const bool log_xy = shape_logs || pow_xy == POW_GENERAL;
+  const bool log_z = shape_logs || pow_z == POW_GENERAL;
+  const bool log_u = shape_logs || pow_u == POW_GENERAL;
+  const bool log_f = shape_logs || pow_f == POW_GENERAL;
+
+  const bool want_residual = (residual != NULL || grad != NULL || squared_sum != NULL);
+  double sum = 0.0;
+
+  for(std::size_t i=0;i<n;i+=W)
+  {
+    const std::size_t m = kernel_min<std::size_t>(W, n - i);
+    V qx, qy, qz;
+    if(m == static_cast<std::size_t>(W))
+    {
+      qx = Tr::load(x + i);
+      qy = Tr::load(y + i);
+      qz = Tr::load(z + i);
+    }
+    else
+    {
+      T bx[W], by[W], bz[W];
+      for(int l=0;l<W;++l)
+      {
+        bx[l] = (static_cast<std::size_t>(l) < m) ? x[i + l] : static_cast<T>(1.0);
+        by[l] = (static_cast<std::size_t>(l) < m) ? y[i + l] : static_cast<T>(1.0);
+        bz[l] = (static_cast<std::size_t>(l) < m) ? z[i + l] : static_cast<T>(1.0);
+      }
+      qx = Tr::load(bx);
+      qy = Tr::load(by);
+      qz = Tr::load(bz);
+    }
+
+    //rigid transformation, w = R * q and p = w + t
+    V wx = Tr::fmadd(rot[0], qx, Tr::fmadd(rot[1], qy, Tr::mul(rot[2], qz)));
+    V wy = Tr::fmadd(rot[3], qx, Tr::fmadd(rot[4], qy, Tr::mul(rot[5], qz)));
+    V wz = Tr::fmadd(rot[6], qx, Tr::fmadd(rot[7], qy, Tr::mul(rot[8], qz)));
+    V px = Tr::add(wx, trans[0]);
+    V py = Tr::add(wy, trans[1]);
+    V pz = Tr::add(wz, trans[2]);
+
+    //|x/a|^(2/e2) evaluated as exp((2/e2) * log|x/a|) unless the exponent is 0.5, 1 or 2
+    V ax = Tr::mul(Tr::abs(px), inv_a);
+    V by = Tr::mul(Tr::abs(py), inv_b);
+    V cz = Tr::mul(Tr::abs(pz), inv_c);
+    V l1 = log_xy ? math.log(ax) : zero;
+    V l2 = log_xy ? math.log(by) : zero;
+    V l3 = log_z ? math.log(cz) : zero;
+    M ax_pos = Tr::gt(ax, zero);
+    M by_pos = Tr::gt(by, zero);
+    M cz_pos = Tr::gt(cz, zero);
+    V t1 = kernel_pow<Tr>(math, pow_xy, ax, ax_pos, p2e2, l1);
+    V t2 = kernel_pow<Tr>(math, pow_xy, by, by_pos, p2e2, l2);
+    V t3 = kernel_pow<Tr>(math, pow_z, cz, cz_pos, p2e1, l3);
+    V u = Tr::add(t1, t2);
+    M u_pos = Tr::gt(u, zero);
+    V lu = log_u ? math.log(u) : zero;
+    V g = kernel_pow<Tr>(math, pow_u, u, u_pos, qe, lu);
+    V f = Tr::add(g, t3);
+
+    if(inside_outside != NULL)
+      kernel_store<Tr>(inside_outside + i, f, m);
+    if(!want_residual)
+      continue;
+
+    M f_pos = Tr::gt(f, zero);
+    V lf = log_f ? math.log(f) : zero;
+    V fp = kernel_pow<Tr>(math, pow_f, f, f_pos, he1, lf);
+    V op = Tr::sqrt(Tr::fmadd(px, px, Tr::fmadd(py, py, Tr::mul(pz, pz))));
+    V F = Tr::sub(fp, one);
+    V r = Tr::mul(Tr::mul(op, F), s);
+
+    if(residual != NULL)
+      kernel_store<Tr>(residual + i, r, m);
+    if(squared_sum != NULL)
+    {
+      T rr[W];
+      Tr::store(rr, Tr::mul(r, r));
+      for(std::size_t l=0;l<m;++l)
+        sum += rr[l];
+    }
+    if(grad == NULL)
+      continue;
+
+    //chain rule through f = (t1 + t2)^(e2/e1) + t3
+    V dF_df = Tr::select(f_pos, Tr::div(Tr::mul(he1, fp), f), zero);
+    V dg_du = Tr::select(u_pos, Tr::div(Tr::mul(qe, g), u), zero);
+    V dFg = Tr::mul(dF_df, dg_du);
+    V ops = Tr::mul(op, s);
+    V w_op = Tr::select(Tr::gt(op, zero), Tr::div(Tr::mul(F, s), op), zero);
+    V dt1 = Tr::mul(p2e2, t1);
+    V dt2 = Tr::mul(p2e2, t2);
+    V dt3 = Tr::mul(p2e1, t3);
+
+    V gx = Tr::fmadd(px, w_op, Tr::mul(ops, Tr::select(Tr::neq(px, zero), Tr::div(Tr::mul(dFg, dt1), px), zero)));
+    V gy = Tr::fmadd(py, w_op, Tr::mul(ops, Tr::select(Tr::neq(py, zero), Tr::div(Tr::mul(dFg, dt2), py), zero)));
+    V gz = Tr::fmadd(pz, w_op, Tr::mul(ops, Tr::select(Tr::neq(pz, zero), Tr::div(Tr::mul(dF_df, dt3), pz), zero)));
+
+    V ga = Tr::fmadd(Tr::mul(quarter, r), inv_a, Tr::mul(ops, Tr::mul(Tr::mul(dFg, dt1), Tr::sub(zero, inv_a))));
+    V gb = Tr::fmadd(Tr::mul(quarter, r), inv_b, Tr::mul(ops, Tr::mul(Tr::mul(dFg, dt2), Tr::sub(zero, inv_b))));
+    V gc = Tr::fmadd(Tr::mul(quarter, r), inv_c, Tr::mul(ops, Tr::mul(Tr::mul(dF_df, dt3), Tr::sub(zero, inv_c))));
+
+    V t1_log = Tr::select(ax_pos, Tr::mul(t1, l1), zero);
+    V t2_log = Tr::select(by_pos, Tr::mul(t2, l2), zero);
+    V t3_log = Tr::select(cz_pos, Tr::mul(t3, l3), zero);
+    V g_log = Tr::select(u_pos, Tr::mul(g, lu), zero);
+    V fp_log = Tr::select(f_pos, Tr::mul(fp, lf), zero);
+    V dg_de2 = Tr::fmadd(Tr::mul(dg_du, de2_scale), Tr::add(t1_log, t2_log), Tr::mul(g_log, de2_g));
+    V df_de1 = Tr::fmadd(g_log, de1_g, Tr::mul(de1_t3, t3_log));
+    V ge1 = Tr::mul(ops, Tr::fmadd(dF_df, df_de1, Tr::mul(de1_fp, fp_log)));
+    V ge2 = Tr::mul(ops, Tr::mul(dF_df, dg_de2));
+
+    //rotation of the rotated point, m = w x dr/dp
+    V mx = Tr::sub(Tr::mul(wy, gz), Tr::mul(wz, gy));
+    V my = Tr::sub(Tr::mul(wz, gx), Tr::mul(wx, gz));
+    V mz = Tr::sub(Tr::mul(wx, gy), Tr::mul(wy, gx));
+
+    kernel_store<Tr>(grad + sq::GRAD_A1 * n + i, ga, m);
+    kernel_store<Tr>(grad + sq::GRAD_A2 * n + i, gb, m);
+    kernel_store<Tr>(grad + sq::GRAD_A3 * n + i, gc, m);
+    kernel_store<Tr>(grad + sq::GRAD_E1 * n + i, ge1, m);
+    kernel_store<Tr>(grad + sq::GRAD_E2 * n + i, ge2, m);
+    kernel_store<Tr>(grad + sq::GRAD_TX * n + i, gx, m);
+    kernel_store<Tr>(grad + sq::GRAD_TY * n + i, gy, m);
+    kernel_store<Tr>(grad + sq::GRAD_TZ * n + i, gz, m);
+    kernel_store<Tr>(grad + sq::GRAD_RX * n + i, mx, m);
+    kernel_store<Tr>(grad + sq::GRAD_RY * n + i, my, m);
+    kernel_store<Tr>(grad + sq::GRAD_RZ * n + i, mz, m);
+  }
+  if(squared_sum != NULL)
+    *squared_sum = sum;
+}
+
+}//end of anonymous namespace
+
+#endif // KERNEL_IMPL_H
@@ -0,0 +1,138 @@
+#include "kernel_impl.h"
+
+// SSE2 is part of the x86_64 baseline, no extra compiler flags are needed
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+namespace {
+
+inline __m128d sse2_round_pd(__m128d a)
+{
+  //adding and removing 1.5 * 2^52 rounds to nearest for |a| < 2^51
+  const __m128d magic = _mm_set1_pd(6755399441055744.0);
+  return _mm_sub_pd(_mm_add_pd(a, magic), magic);
+}
+
+struct Sse2Double
+{
+  typedef double T;
+  typedef __m128d V;
+  typedef __m128d M;
+  enum { W = 2 };
+
+  static V load(const T* p) { return _mm_loadu_pd(p); }
+  static void store(T* p, V v) { _mm_storeu_pd(p, v); }
+  static V set1(T v) { return _mm_set1_pd(v); }
+  static V add(V a, V b) { return _mm_add_pd(a, b); }
+  static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+  static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+  static V div(V a, V b) { return _mm_div_pd(a, b); }
+  static V fmadd(V a, V b, V c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+  static V sqrt(V a) { return _mm_sqrt_pd(a); }
+  static V abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+  static V min(V a, V b) { return _mm_min_pd(a, b); }
+  static V max(V a, V b) { return _mm_max_pd(a, b); }
+  static V round(V a) { return sse2_round_pd(a); }
+  static M gt(V a, V b) { return _mm_cmpgt_pd(a, b); }
+  static M lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+  static M neq(V a, V b) { return _mm_andnot_pd(_mm_cmpeq_pd(a, b), _mm_cmpord_pd(a, b)); }
+  static V select(M m, V a, V b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+
+  //mantissa in [0.5, 1) and exponent of x > 0
+  static V frexp(V x, V& e)
+  {
+    const __m128i bits = _mm_castpd_si128(x);
+    const __m128d magic = _mm_set1_pd(4503599627370496.0);
+    __m128i biased = _mm_srli_epi64(bits, 52);
+    e = _mm_sub_pd(_mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(biased, _mm_castpd_si128(magic))), magic),
+                   _mm_set1_pd(1022.0));
+    __m128i mantissa = _mm_and_si128(bits, _mm_set1_epi64x(0x000FFFFFFFFFFFFFLL));
+    return _mm_castsi128_pd(_mm_or_si128(mantissa, _mm_set1_epi64x(0x3FE0000000000000LL)));
+  }
+
+  //2^n for integral n in [-1022, 1023]
+  static V pow2n(V n)
+  {
+    __m128d biased = _mm_add_pd(n, _mm_set1_pd(4503599627370496.0 + 1023.0));
+    return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(biased), 52));
+  }
+
+  static V log(V x) { return cephes_log_d<Sse2Double>(x); }
+  static V exp(V x) { return cephes_exp_d<Sse2Double>(x); }
+};
+
+struct Sse2Float
+{
+  typedef float T;
+  typedef __m128 V;
+  typedef __m128 M;
+  enum { W = 4 };
+
+  static V load(const T* p) { return _mm_loadu_ps(p); }
+  static void store(T* p, V v) { _mm_storeu_ps(p, v); }
+  static V set1(T v) { return _mm_set1_ps(v); }
+  static V add(V a, V b) { return _mm_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V div(V a, V b) { return _mm_div_ps(a, b); }
+  static V fmadd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static V sqrt(V a) { return _mm_sqrt_ps(a); }
+  static V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  static V min(V a, V b) { return _mm_min_ps(a, b); }
+  static V max(V a, V b) { return _mm_max_ps(a, b); }
+  static V round(V a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+  static M gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+  static M lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static M neq(V a, V b) { return _mm_andnot_ps(_mm_cmpeq_ps(a, b), _mm_cmpord_ps(a, b)); }
+  static V select(M m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+  static V frexp(V x, V& e)
+  {
+    const __m128i bits = _mm_castps_si128(x);
+    e = _mm_sub_ps(_mm_cvtepi32_ps(_mm_srli_epi32(bits, 23)), _mm_set1_ps(126.0f));
+    __m128i mantissa = _mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF));
+    return _mm_castsi128_ps(_mm_or_si128(mantissa, _mm_set1_epi32(0x3F000000)));
+  }
+
+  static V pow2n(V n)
+  {
+    __m128i biased = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+    return _mm_castsi128_ps(_mm_slli_epi32(biased, 23));
+  }
+
+  static V log(V x) { return cephes_log_f<Sse2Float>(x); }
+  static V exp(V x) { return cephes_exp_f<Sse2Float>(x); }
+};
+
+void evaluate_sse2_d(const double* x, const double* y, const double* z, const std::size_t n, const sq::SQKernelParam& param,
+                     const sq::KernelAccuracy accuracy, double* inside_outside,
+                     double* residual, double* grad, double* squared_sum)
+{
+  sq_kernel_evaluate<Sse2Double>(x, y, z, n, param, accuracy, inside_outside, residual, grad, squared_sum);
+}
+
+void evaluate_sse2_f(const float* x, const float* y, const float* z, const std::size_t n, const sq::SQKernelParam& param,
+                     const sq::KernelAccuracy accuracy, float* inside_outside,
+                     float* residual, float* grad, double* squared_sum)
+{
+  sq_kernel_evaluate<Sse2Float>(x, y, z, n, param, accuracy, inside_outside, residual, grad, squared_sum);
+}
+
+}//end of anonymous namespace
+
+bool sq::detail::kernel_sse2_functions(KernelEvaluateD& evaluate_d, KernelEvaluateF& evaluate_f)
+{
+  evaluate_d = &evaluate_sse2_d;
+  evaluate_f = &evaluate_sse2_f;
+  return true;
+}
+
+#else
+
+bool sq::detail::kernel_sse2_functions(KernelEvaluateD& evaluate_d, KernelEvaluateF& evaluate_f)
+{
+  return false;
+}
+
+#endif
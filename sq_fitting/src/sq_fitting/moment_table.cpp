@@ -0,0 +1,160 @@
+#include <sq_fitting/moment_table.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+namespace sq {
+
+///file header, followed by the bins, the features and size() entries of 6 bytes
+static const char MOMENT_TABLE_MAGIC[4] = {'S', 'Q', 'M', 'T'};
+
+void MomentDescriptor::features(double *values) const
+{
+  const double epsilon = std::numeric_limits<double>::epsilon();
+  values[0] = deviation(1) / std::max(deviation(0), epsilon);
+  values[1] = deviation(2) / std::max(deviation(1), epsilon);
+  for(int k=0;k<3;++k)
+    values[2 + k] = deviation(k) / std::max(half_extent(k), epsilon);
+  for(int k=0;k<MomentTable::FEATURES;++k)
+    values[k] = std::min(std::max(values[k], 0.), 1.);
+}
+
+void momentDescriptor(const PointBuffer &points, MomentDescriptor &descriptor)
+{
+  Eigen::Vector3d min_pt = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d max_pt = -min_pt;
+  Eigen::Vector3d squares = Eigen::Vector3d::Zero();
+  for(size_t i=0;i<points.size();++i)
+  {
+    const Eigen::Vector3d p(points.x[i], points.y[i], points.z[i]);
+    min_pt = min_pt.cwiseMin(p);
+    max_pt = max_pt.cwiseMax(p);
+    squares += p.cwiseProduct(p);
+  }
+  if(points.size() == 0)
+    min_pt = max_pt = Eigen::Vector3d::Zero();
+  descriptor.center = 0.5 * (max_pt + min_pt);
+  descriptor.half_extent = 0.5 * (max_pt - min_pt);
+  descriptor.deviation = (squares / std::max<size_t>(points.size(), 1)).cwiseSqrt();
+}
+
+MomentTable::MomentTable()
+{
+}
+
+std::size_t MomentTable::size()
+{
+  std::size_t cells = 1;
+  for(int k=0;k<FEATURES;++k)
+    cells *= BINS;
+  return cells;
+}
+
+bool MomentTable::empty() const
+{
+  return entries_.empty();
+}
+
+std::size_t MomentTable::cell(const MomentDescriptor &descriptor)
+{
+  double values[FEATURES];
+  descriptor.features(values);
+  std::size_t index = 0;
+  for(int k=0;k<FEATURES;++k)
+    index = index * BINS + std::min(static_cast<int>(values[k] * BINS), BINS - 1);
+  return index;
+}
+
+bool MomentTable::lookup(const MomentDescriptor &descriptor, Shape &shape) const
+{
+  if(entries_.empty())
+    return false;
+  shape = decode(entries_[cell(descriptor)]);
+  shape.size = shape.size.cwiseProduct(descriptor.half_extent);
+  return true;
+}
+
+void MomentTable::setEntries(const std::vector<Entry> &entries)
+{
+  entries_ = entries;
+}
+
+/**
+ * @brief rounds v from [min, max] to a byte
+ */
+static uint8_t quantize(const double v, const double min, const double max)
+{
+  const double t = (std::min(std::max(v, min), max) - min) / (max - min);
+  return static_cast<uint8_t>(std::floor(t * 255. + 0.5));
+}
+
+static double dequantize(const uint8_t q, const double min, const double max)
+{
+  return min + q * (max - min) / 255.;
+}
+
+MomentTable::Entry MomentTable::encode(const Shape &relative)
+{
+  Entry entry;
+  entry.axis = static_cast<uint8_t>(relative.axis);
+  entry.e1 = quantize(relative.e1, 0.1, 1.9);
+  entry.e2 = quantize(relative.e2, 0.1, 1.9);
+  for(int k=0;k<3;++k)
+    entry.size[k] = quantize(relative.size(k), 0., 2.);
+  return entry;
+}
+
+MomentTable::Shape MomentTable::decode(const Entry &entry)
+{
+  Shape shape;
+  shape.axis = std::min<int>(entry.axis, 2);
+  shape.e1 = dequantize(entry.e1, 0.1, 1.9);
+  shape.e2 = dequantize(entry.e2, 0.1, 1.9);
+  for(int k=0;k<3;++k)
+    shape.size(k) = dequantize(entry.size[k], 0., 2.);
+  return shape;
+}
+
+bool MomentTable::load(const std::string &path)
+{
+  entries_.clear();
+  std::ifstream file(path.c_str(), std::ios::binary);
+  char magic[4];
+  uint8_t bins, features;
+  if(!file.read(magic, 4) || !std::equal(magic, magic + 4, MOMENT_TABLE_MAGIC))
+    return false;
+  if(!file.read(reinterpret_cast<char*>(&bins), 1) || !file.read(reinterpret_cast<char*>(&features), 1) ||
+     bins != BINS || features != FEATURES)
+    return false;
+  std::vector<Entry> entries(size());
+  for(size_t i=0;i<entries.size();++i)
+  {
+    uint8_t bytes[6];
+    if(!file.read(reinterpret_cast<char*>(bytes), 6))
+      return false;
+    entries[i].axis = bytes[0];
+    entries[i].e1 = bytes[1];
+    entries[i].e2 = bytes[2];
+    std::copy(bytes + 3, bytes + 6, entries[i].size);
+  }
+  entries_.swap(entries);
+  return true;
+}
+
+bool MomentTable::save(const std::string &path) const
+{
+  std::ofstream file(path.c_str(), std::ios::binary);
+  const uint8_t header[2] = {BINS, FEATURES};
+  file.write(MOMENT_TABLE_MAGIC, 4);
+  file.write(reinterpret_cast<const char*>(header), 2);
+  for(size_t i=0;i<entries_.size();++i)
+  {
+    const uint8_t bytes[6] = {entries_[i].axis, entries_[i].e1, entries_[i].e2,
+                              entries_[i].size[0], entries_[i].size[1], entries_[i].size[2]};
+    file.write(reinterpret_cast<const char*>(bytes), 6);
+  }
+  return static_cast<bool>(file);
+}
+
+}//end of namespace
@@ -0,0 +1,197 @@
+#include <sq_fitting/robust_fitting.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+RobustSuperquadricFitting::RobustSuperquadricFitting(const pcl::PointCloud<PointT>::Ptr& input_cloud)
+  : SuperquadricFitting(input_cloud)
+{
+  sample_size_ = 30;
+  max_iterations_ = 100;
+  inlier_threshold_ = 0.005;
+  refinements_ = 3;
+  probability_ = 0.99;
+  loss_ = LOSS_HUBER;
+}
+
+void RobustSuperquadricFitting::setSampleSize(int sample_size)
+{
+  sample_size_ = std::max(sample_size, 11);
+}
+
+void RobustSuperquadricFitting::setMaxIterations(int max_iterations)
+{
+  max_iterations_ = max_iterations;
+}
+
+void RobustSuperquadricFitting::setInlierThreshold(double threshold)
+{
+  inlier_threshold_ = threshold;
+}
+
+void RobustSuperquadricFitting::setProbability(double probability)
+{
+  probability_ = probability;
+}
+
+void RobustSuperquadricFitting::getInliers(std::vector<int> &inliers)
+{
+  inliers = inliers_;
+}
+
+void RobustSuperquadricFitting::setRefinements(int refinements)
+{
+  refinements_ = refinements;
+}
+
+int RobustSuperquadricFitting::countInliers(const sq::PointBuffer &points, const Vector11d &xvec,
+                                            const double threshold, std::vector<double> &residual,
+                                            std::vector<int>* inliers)
+{
+  sq::SQKernelParam param;
+  sq::create_kernel_param(xvec, param);
+  param.accuracy = kernel_accuracy_;
+  sq::sq_batch_radial_residual(points.x.data(), points.y.data(), points.z.data(), points.size(), param,
+                               residual.data());
+
+  //without the scale weighting the residual ||OP|| * (F^(e1/2) - 1) is the distance to the
+  //surface along the ray of the point, close to the surface
+  const double bound = threshold * pow(std::abs(xvec[0] * xvec[1] * xvec[2]), 0.25);
+  int count = 0;
+  if(inliers)
+    inliers->clear();
+  for(size_t i=0;i<points.size();++i)
+  {
+    if(std::abs(residual[i]) <= bound)
+    {
+      ++count;
+      if(inliers)
+        inliers->push_back(i);
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief copies the points at the indices
+ */
+static void selectPoints(const sq::PointBuffer& points, const std::vector<int>& indices, sq::PointBuffer& selected)
+{
+  selected.x.resize(indices.size());
+  selected.y.resize(indices.size());
+  selected.z.resize(indices.size());
+  for(size_t i=0;i<indices.size();++i)
+  {
+    selected.x[i] = points.x[indices[i]];
+    selected.y[i] = points.y[indices[i]];
+    selected.z[i] = points.z[indices[i]];
+  }
+}
+
+void RobustSuperquadricFitting::fit()
+{
+  resetReport();
+  context_->reset();
+  report_.n_points = cloud_->size();
+  Eigen::Affine3f transform_inv;
+  Eigen::Vector3f variances;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  computePreAlignedCloud(transform_inv, variances);
+  report_.prealign_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  const size_t n = prealigned_points_.size();
+  //subsets cycle through the multi start hypotheses, unless there is an initial guess or
+  //a support plane
+  std::vector<Vector11d> initial(1);
+  initialParameters(transform_inv, variances, initial[0]);
+  if(!has_initial_guess_ && !has_support_plane_)
+  {
+    initial.resize(6);
+    for(size_t i=0;i<initial.size();++i)
+      hypothesisParameters(i % 3, i >= 3, variances, initial[i]);
+  }
+
+  //subsets are fitted with the squared loss, the loss of the estimator refines the inliers
+  const Loss loss = loss_;
+  loss_ = LOSS_SQUARED;
+  Vector11d best = initial[0];
+  int max_inliers = -1;
+  std::vector<double> residual(n);
+  if(n > static_cast<size_t>(sample_size_))
+  {
+    std::mt19937 generator(0);
+    std::vector<size_t> indices(n);
+    for(size_t i=0;i<n;++i)
+      indices[i] = i;
+    sq::PointBuffer sample;
+    sample.x.resize(sample_size_);
+    sample.y.resize(sample_size_);
+    sample.z.resize(sample_size_);
+
+    int needed_iterations = max_iterations_;
+    for(int iteration=0;iteration<needed_iterations;++iteration)
+    {
+      for(int i=0;i<sample_size_;++i)
+      {
+        std::uniform_int_distribution<size_t> distribution(i, n - 1);
+        std::swap(indices[i], indices[distribution(generator)]);
+        sample.x[i] = prealigned_points_.x[indices[i]];
+        sample.y[i] = prealigned_points_.y[indices[i]];
+        sample.z[i] = prealigned_points_.z[indices[i]];
+      }
+      Vector11d xvec = initial[iteration % initial.size()];
+      minimize(sample, NULL, xvec, report_, *context_);
+      int count = countInliers(prealigned_points_, xvec, inlier_threshold_, residual, NULL);
+      if(count > max_inliers)
+      {
+        max_inliers = count;
+        best = xvec;
+        //subsets needed to draw one without outliers with probability_
+        const double clean = pow(static_cast<double>(count) / n, sample_size_);
+        if(clean >= 1.)
+          needed_iterations = 0;
+        else if(clean > 0.)
+          needed_iterations = std::min(static_cast<double>(max_iterations_), ceil(log(1. - probability_) / log(1. - clean)));
+        //every start is tried at least once
+        needed_iterations = std::max(needed_iterations, static_cast<int>(initial.size()));
+      }
+    }
+  }
+  loss_ = loss;
+
+  //refine on the inliers under a threshold shrinking to the inlier threshold, so that the
+  //inliers of a subset fit can grow to the whole object. Keep refinements with more inliers
+  sq::PointBuffer inlier_points;
+  sq::PointBuffer inlier_normals;
+  std::vector<int> inliers;
+  max_inliers = countInliers(prealigned_points_, best, inlier_threshold_, residual, NULL);
+  for(int refinement=0;refinement<refinements_;++refinement)
+  {
+    const double threshold = inlier_threshold_ * (refinements_ - refinement);
+    if(countInliers(prealigned_points_, best, threshold, residual, &inliers) < sample_size_)
+    {
+      inliers.resize(n);
+      for(size_t i=0;i<n;++i)
+        inliers[i] = i;
+    }
+    selectPoints(prealigned_points_, inliers, inlier_points);
+    if(!prealigned_normals_.x.empty())
+      selectPoints(prealigned_normals_, inliers, inlier_normals);
+    Vector11d xvec = best;
+    minimizePyramid(inlier_points, &inlier_normals, xvec, report_, *context_);
+    int count = countInliers(prealigned_points_, xvec, inlier_threshold_, residual, NULL);
+    if(count > max_inliers)
+    {
+      max_inliers = count;
+      best = xvec;
+    }
+  }
+  start = std::chrono::steady_clock::now();
+  countInliers(prealigned_points_, best, inlier_threshold_, residual, &inliers_);
+  selectPoints(prealigned_points_, inliers_, inlier_points);
+
+  sq_fitting::sq param_lm;
+  vectorToParam(best, transform_inv, params_, param_lm);
+  min_error_ = sq::sq_error(inlier_points, param_lm);
+  report_.final_error = min_error_;
+  report_.error_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
@@ -1,7 +1,9 @@
 #include <sq_fitting/sampling.h>
 #include <ctime>
 
-SuperquadricSampling::SuperquadricSampling(const sq_fitting::sq &sq_params) : params_(sq_params), cloud_(new pcl::PointCloud<PointT>)
+template<typename PointType>
+SuperquadricSamplingT<PointType>::SuperquadricSamplingT(const sq_fitting::sq &sq_params) : params_(sq_params),
+  cloud_(new pcl::PointCloud<PointType>)
 {
   struct timeval time;
   gettimeofday(&time,NULL);
@@ -11,7 +13,24 @@ SuperquadricSampling::SuperquadricSampling(const sq_fitting::sq &sq_params) : pa
   b_ = static_cast<float> (rand())/static_cast<float> (RAND_MAX);
 }
 
-void SuperquadricSampling::transformCloud(const pcl::PointCloud<PointT>::Ptr &input_cloud, pcl::PointCloud<PointT>::Ptr& output_cloud)
+/**
+ * @brief sets the color of points which have one
+ */
+template<typename PointType>
+static void setColor(PointType& point, const float r, const float g, const float b)
+{
+}
+
+static void setColor(pcl::PointXYZRGB& point, const float r, const float g, const float b)
+{
+  point.r = r * 255;
+  point.g = g * 255;
+  point.b = b * 255;
+}
+
+template<typename PointType>
+void SuperquadricSamplingT<PointType>::transformCloud(const typename pcl::PointCloud<PointType>::Ptr &input_cloud,
+                                                      typename pcl::PointCloud<PointType>::Ptr& output_cloud)
 {
   Eigen::Affine3f transform;
   sq::sq_create_transform(params_.pose, transform);
@@ -19,9 +38,10 @@ void SuperquadricSampling::transformCloud(const pcl::PointCloud<PointT>::Ptr &in
 }
 
 //Similar to sampling in https://github.com/ana-GT/GSoC_PCL
-void SuperquadricSampling::sample()
+template<typename PointType>
+void SuperquadricSamplingT<PointType>::sample()
 {
-  pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+  typename pcl::PointCloud<PointType>::Ptr cloud(new pcl::PointCloud<PointType>);
   double cn, sn, sw, cw;
   double n,w;
   int num_n, num_w;
@@ -42,13 +62,11 @@ void SuperquadricSampling::sample()
       w+=dw;
       cw = cos(w);
       sw = sin(w);
-      PointT p;
+      PointType p;
       p.x = params_.a1 * pow(fabs(cn), params_.e1) * pow (fabs(cw), params_.e2);
       p.y = params_.a2 * pow(fabs(cn), params_.e1) * pow (fabs(sw), params_.e2);
       p.z = params_.a3 * pow(fabs(sn), params_.e1);
-      p.r =  r_*255;
-      p.g = g_*255;
-      p.b = b_*255;
+      setColor(p, r_, g_, b_);
 
       if(cn*cw <0){p.x = -p.x;}
       if(cn*sw <0){p.y = -p.y;}
@@ -78,10 +96,12 @@ static double dTheta(double K, double e, double a1, double a2, double t)
   return (K/e)*sqrt(num/(den1+den2));
 }
 
-static void sample_superEllipse(const double a1, const double a2, const double e, const int N, pcl::PointCloud<PointT>::Ptr &cloud)
+template<typename PointType>
+static void sample_superEllipse(const double a1, const double a2, const double e, const int N,
+                                typename pcl::PointCloud<PointType>::Ptr &cloud)
 {
   cloud->points.resize(0);
-  pcl::PointCloud<PointT>::Ptr cloud_base(new pcl::PointCloud<PointT>);
+  typename pcl::PointCloud<PointType>::Ptr cloud_base(new pcl::PointCloud<PointType>);
   double theta;
   double thresh = 0.1;
   int numIter;
@@ -100,7 +120,7 @@ static void sample_superEllipse(const double a1, const double a2, const double e
 
     if(dt !=0)
     {
-      PointT p;
+      PointType p;
       p.x = a1 * pow(fabs(cos(theta)), e);
       p.y = a2 * pow(fabs(sin(theta)), e);
       p.z = 0;
@@ -115,7 +135,7 @@ static void sample_superEllipse(const double a1, const double a2, const double e
   {
     theta +=dTheta(K, e, a1,a2, theta);
     numIter++;
-    PointT p;
+    PointType p;
     p.x = a1 * pow(fabs(cos(theta)), e);
     p.y = a2 * pow(fabs(sin(theta)), e);
     p.z = 0;
@@ -129,7 +149,7 @@ static void sample_superEllipse(const double a1, const double a2, const double e
   {
     alpha -=dTheta(K, e, a2, a1, alpha);
     numIter++;
-    PointT p;
+    PointType p;
     p.x = a1 * pow(fabs(sin(alpha)),e);
     p.y = a2 * pow(fabs(cos(alpha)),e);
     p.z = 0;
@@ -142,7 +162,7 @@ static void sample_superEllipse(const double a1, const double a2, const double e
   {
     for (int j=0;j<cloud_base->points.size();++j)
     {
-      PointT p, b;
+      PointType p, b;
       b = cloud_base->points[j];
       p.x = xsign[i] * b.x;
       p.y = ysign[i] * b.y;
@@ -154,15 +174,16 @@ static void sample_superEllipse(const double a1, const double a2, const double e
   cloud->height = cloud->points.size();
 }
 
-void SuperquadricSampling::sample_pilu_fisher()
+template<typename PointType>
+void SuperquadricSamplingT<PointType>::sample_pilu_fisher()
 {
-  pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
-  pcl::PointCloud<PointT>::Ptr cloud_s1(new pcl::PointCloud<PointT>);
-  pcl::PointCloud<PointT>::Ptr cloud_s2(new pcl::PointCloud<PointT>);
+  typename pcl::PointCloud<PointType>::Ptr cloud(new pcl::PointCloud<PointType>);
+  typename pcl::PointCloud<PointType>::Ptr cloud_s1(new pcl::PointCloud<PointType>);
+  typename pcl::PointCloud<PointType>::Ptr cloud_s2(new pcl::PointCloud<PointType>);
   int N = 300;
-  sample_superEllipse(1, params_.a3, params_.e1, N, cloud_s1);
-  sample_superEllipse(params_.a1, params_.a2, params_.e2, N, cloud_s2);
-  PointT p1, p2;
+  sample_superEllipse<PointType>(1, params_.a3, params_.e1, N, cloud_s1);
+  sample_superEllipse<PointType>(params_.a1, params_.a2, params_.e2, N, cloud_s2);
+  PointType p1, p2;
   int n = cloud_s1->points.size()/4;
   for(int i=n;i<4*n;++i)
   {
@@ -170,13 +191,11 @@ void SuperquadricSampling::sample_pilu_fisher()
     for(int j=0;j<cloud_s2->points.size();++j)
     {
       p2 = cloud_s2->points[j];
-      PointT p;
+      PointType p;
       p.x = p1.x * p2.x;
       p.y = p1.x * p2.y;
       p.z = p1.y;
-      p.r =  r_*255;
-      p.g = g_*255;
-      p.b = b_*255;
+      setColor(p, r_, g_, b_);
       cloud->points.push_back(p);
     }
   }
@@ -186,14 +205,20 @@ void SuperquadricSampling::sample_pilu_fisher()
   transformCloud(cloud, cloud_);
 }
 
-void SuperquadricSampling::getCloud(pcl::PointCloud<PointT>::Ptr& cloud)
+template<typename PointType>
+void SuperquadricSamplingT<PointType>::getCloud(typename pcl::PointCloud<PointType>::Ptr& cloud)
 {
   cloud = cloud_;
 }
 
-void SuperquadricSampling::getCloud(sensor_msgs::PointCloud2 &cloud_ros)
+template<typename PointType>
+void SuperquadricSamplingT<PointType>::getCloud(sensor_msgs::PointCloud2 &cloud_ros)
 {
   pcl::toROSMsg(*cloud_, cloud_ros);
 }
 
 // test
+
+template class SuperquadricSamplingT<pcl::PointXYZ>;
+template class SuperquadricSamplingT<pcl::PointXYZRGB>;
+template class SuperquadricSamplingT<pcl::PointNormal>;
@@ -4,6 +4,7 @@
 #include <pcl/PCLPointCloud2.h>
 #include <pcl/conversions.h>
 #include <pcl_ros/transforms.h>
+#include <limits>
 
 LccpSegmentationAlgorithm::LccpSegmentationAlgorithm(ros::NodeHandle *handle, const Parameters &param, std::string name):
   nh_(*handle), service_name_(name){
@@ -52,6 +53,10 @@ bool LccpSegmentationAlgorithm::segmentationCallback(sq_fitting::segment_object:
   //Table cloud
   CloudPtr table_cloud = seg->get_plane_cloud();
   pcl::toROSMsg(*table_cloud, res.plane_cloud);
+  //Table plane in the frame of the input cloud
+  pcl::ModelCoefficients plane_coefficients = seg->get_plane_coefficients();
+  if(plane_coefficients.values.size() == 4)
+    res.plane_coefficients.assign(plane_coefficients.values.begin(), plane_coefficients.values.end());
 
   //Object clouds
   for(uint i=0;i<seg_objs.size();++i){
@@ -61,6 +66,10 @@ bool LccpSegmentationAlgorithm::segmentationCallback(sq_fitting::segment_object:
     obj_msg.header.frame_id = req.input_cloud.header.frame_id;
     obj_msg.header.stamp = ros::Time::now();
     res.object_cloud.push_back(obj_msg);
+    sensor_msgs::PointCloud2 normals_msg;
+    pcl::toROSMsg(seg_objs[i].obj_normals, normals_msg);
+    normals_msg.header = obj_msg.header;
+    res.object_normals.push_back(normals_msg);
   }
   this->obj_seg_mutex_exit_();
   return true;
@@ -154,6 +163,10 @@ CloudPtr lccp_segmentation::get_plane_cloud(){
   return this->table_plane_cloud_;
 }
 
+pcl::ModelCoefficients lccp_segmentation::get_plane_coefficients(){
+  return this->plane_coefficients_;
+}
+
 void lccp_segmentation::detectObjectsOnTable(CloudPtr cloud, double zmin, double zmax, pcl::PointIndices::Ptr objectIndices, bool filter_input_cloud){
   //objects for storing point clouds
   CloudPtr plane(new PointCloud);
@@ -265,6 +278,9 @@ bool lccp_segmentation::segment(){
   lccp_labeled_cloud_ = labeled_cloud->makeShared();
   lccp.relabelCloud(*lccp_labeled_cloud_);
 
+  //the supervoxel labels, before the relabeling, give the normal of every point
+  pcl::Normal nan_normal;
+  nan_normal.normal_x = nan_normal.normal_y = nan_normal.normal_z = std::numeric_limits<float>::quiet_NaN();
   for(int i=0;i < lccp_labeled_cloud_->points.size(); ++i){
     uint32_t idx = lccp_labeled_cloud_->points.at(i).label;
     if(idx >= detected_objects_.size())
@@ -272,6 +288,10 @@ bool lccp_segmentation::segment(){
     PointT tmp_point_rgb;
     tmp_point_rgb = cloud_->points.at(i);
     detected_objects_[idx].obj_cloud.points.push_back(tmp_point_rgb);
+    std::map<uint32_t, pcl::Supervoxel<PointT>::Ptr>::const_iterator supervoxel =
+        supervoxel_clusters_.find(labeled_cloud->points.at(i).label);
+    detected_objects_[idx].obj_normals.points.push_back(supervoxel != supervoxel_clusters_.end() ?
+                                                          supervoxel->second->normal_ : nan_normal);
     detected_objects_[idx].label = (int)idx;
   }
 
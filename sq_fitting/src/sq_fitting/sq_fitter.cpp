@@ -11,6 +11,7 @@
 #include <visualization_msgs/Marker.h>
 #include <sq_fitting/segment_object.h>
 #include <chrono>
+#include <sq_fitting/thread_pool.h>
 
 
 
@@ -27,6 +28,7 @@ SQFitter::SQFitter(ros::NodeHandle &node, const std::string &segmentation_servic
   filtered_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>("filtered_cloud",10);
   superquadrics_pub_ = nh_.advertise<sensor_msgs::PointCloud2>("superquadrics",10);
   poses_pub_ = nh_.advertise<geometry_msgs::PoseArray>("sq_poses",10);
+  fit_reports_pub_ = nh_.advertise<sq_fitting::fitReportArray>("fit_reports",10);
 
 
   cut_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>("cut_cloud", 10);
@@ -36,6 +38,10 @@ SQFitter::SQFitter(ros::NodeHandle &node, const std::string &segmentation_servic
   service_ = nh_.advertiseService("sqs", &SQFitter::serviceCallback, this);
 
   this->sq_param_ = params;
+  if(sq_param_.support_plane != "none" && sq_param_.support_plane != "plane" && sq_param_.support_plane != "tangent")
+    ROS_ERROR("Support plane not recognized");
+  if(!sq_param_.moment_table.empty() && !moment_table_.load(sq_param_.moment_table))
+    ROS_ERROR("Could not load moment table %s", sq_param_.moment_table.c_str());
   this->initialized = true;
   Objects_.resize(0);
   pVector_.resize(0);
@@ -107,6 +113,48 @@ void SQFitter::transformFrameCloud(const CloudPtr& cloud_in, CloudPtr& cloud_out
     cloud_out = cloud_in;
 }
 
+bool SQFitter::lookupOutputTransform(Eigen::Affine3d& transform)
+{
+  transform.setIdentity();
+  if(output_frame_ == this->input_msg_.header.frame_id)
+    return true;
+  tf::TransformListener listener;
+  tf::StampedTransform stamped_transform;
+  try{
+    listener.waitForTransform(output_frame_,this->input_msg_.header.frame_id,ros::Time(0), ros::Duration(3.0));
+    listener.lookupTransform(output_frame_, this->input_msg_.header.frame_id,ros::Time(0), stamped_transform);
+  }
+  catch (tf::TransformException ex){
+    ROS_ERROR("%s",ex.what());
+    return false;
+  }
+  tf::transformTFToEigen(stamped_transform, transform);
+  return true;
+}
+
+bool SQFitter::transformFramePlane(const std::vector<double>& plane_in, const Eigen::Affine3d& transform,
+                                   std::vector<double>& plane_out)
+{
+  if(plane_in.size() != 4)
+    return false;
+  plane_out = plane_in;
+  //n.p + d = 0 with p = R^T (q - t) gives (R n).q + d - (R n).t = 0
+  const Eigen::Vector3d normal = transform.linear() * Eigen::Vector3d(plane_in[0], plane_in[1], plane_in[2]);
+  plane_out[0] = normal(0);
+  plane_out[1] = normal(1);
+  plane_out[2] = normal(2);
+  plane_out[3] = plane_in[3] - normal.dot(transform.translation());
+  return true;
+}
+
+void SQFitter::transformFrameNormals(const pcl::PointCloud<pcl::Normal>& normals_in, const Eigen::Matrix3f& rotation,
+                                     pcl::PointCloud<pcl::Normal>& normals_out)
+{
+  normals_out = normals_in;
+  for(size_t i=0;i<normals_out.points.size();++i)
+    normals_out.points[i].getNormalVector3fMap() = rotation * normals_in.points[i].getNormalVector3fMap();
+}
+
 void SQFitter::transformFrameCloudBack(const CloudPtr& cloud_in, CloudPtr& cloud_out)
 {
   if(output_frame_ == this->input_msg_.header.frame_id)
@@ -187,7 +235,7 @@ void SQFitter::filter_RadiusOutlier(CloudPtr &cloud_in, CloudPtr &cloud_out)
 void SQFitter::mirror_cloud(CloudPtr &cloud_in, CloudPtr &cloud_out)
 {
   double x, y,z;
-  sq::getCenter(cloud_in, x, y, z);
+  sq::getCenter(*cloud_in, x, y, z);
   geometry_msgs::Pose pose_in;
   pose_in.position.x = x;
   pose_in.position.y = y;
@@ -279,6 +327,7 @@ void SQFitter::transformFrame(const geometry_msgs::Pose &pose_in, geometry_msgs:
 void SQFitter::getSegmentedObjects(CloudPtr& cloud)
 {
   Objects_.resize(0);
+  object_normals_.resize(0);
   std::vector<CloudPtr> segmented_clouds;
   CloudPtr transform_cloud(new PointCloud);
   transformFrameCloudBack(cloud, transform_cloud);
@@ -286,13 +335,32 @@ void SQFitter::getSegmentedObjects(CloudPtr& cloud)
   pcl::toROSMsg(*transform_cloud, cloud_msg);
   sq_fitting::segment_object srv;
   srv.request.input_cloud = cloud_msg;
+  table_plane_.clear();
   if(client_.call(srv)){
     table_cloud_ = srv.response.plane_cloud;
+    //the plane and the normals of every object share one lookup of the transform
+    Eigen::Affine3d output_transform;
+    const bool has_transform = lookupOutputTransform(output_transform);
+    if(!has_transform || !transformFramePlane(srv.response.plane_coefficients, output_transform, table_plane_))
+      table_plane_.clear();
     pcl::PointCloud<pcl::PointXYZRGB> segmented_objects_cloud;
     for(int i=0;i<srv.response.object_cloud.size();++i){
       CloudPtr tmp(new PointCloud);
       pcl::fromROSMsg(srv.response.object_cloud[i], *tmp);
       segmented_clouds.push_back(tmp);
+      //supervoxel normals, only if they match the points of the object
+      pcl::PointCloud<pcl::Normal>::Ptr normals;
+      if(sq_param_.normal_weight > 0 && i < srv.response.object_normals.size())
+      {
+        pcl::PointCloud<pcl::Normal> sensor_normals;
+        pcl::fromROSMsg(srv.response.object_normals[i], sensor_normals);
+        if(has_transform && sensor_normals.points.size() == tmp->points.size())
+        {
+          normals.reset(new pcl::PointCloud<pcl::Normal>);
+          transformFrameNormals(sensor_normals, output_transform.linear().cast<float>(), *normals);
+        }
+      }
+      object_normals_.push_back(normals);
       float r = static_cast<float> (rand())/static_cast<float>(RAND_MAX);
       float g = static_cast<float> (rand())/static_cast<float>(RAND_MAX);
       float b = static_cast<float> (rand())/static_cast<float>(RAND_MAX);
@@ -326,20 +394,158 @@ void SQFitter::getSegmentedObjects(CloudPtr& cloud)
   }
 }
 
-void SQFitter::fitAndSampleTh(CloudPtr &cloud_in,std::string& method, ParamMultiVector& pvector){
-  std::unique_ptr<SuperquadricFitting> fit(new SuperquadricFitting(cloud_in));
+void SQFitter::createFitting(CloudPtr &cloud_in, const std::string& method, const sq_fitting::sq* guess,
+                             const pcl::PointCloud<pcl::Normal>::ConstPtr& normals, sq::FittingContext* context,
+                             std::unique_ptr<SuperquadricFitting>& fit)
+{
+  if(sq_param_.fitting_method == "ransac")
+    fit.reset(new RobustSuperquadricFitting(cloud_in));
+  else
+    fit.reset(new SuperquadricFitting(cloud_in));
+  fit->setContext(context);
   if(!fit->set_pose_est_method(method))
     ROS_ERROR("Method not recognized");
-  fit->fit();
-  sq_fitting::sq min_param;
-  fit->getMinParams(min_param);
+  if(!fit->set_precision(sq_param_.fitting_precision))
+    ROS_ERROR("Precision not recognized");
+  if(!fit->set_rotation(sq_param_.fitting_rotation))
+    ROS_ERROR("Rotation not recognized");
+  if(!fit->set_kernel_accuracy(sq_param_.kernel_accuracy))
+    ROS_ERROR("Kernel accuracy not recognized");
+  fit->setBounds(sq_param_.bounded);
+  fit->setPrimitives(sq_param_.primitives, sq_param_.primitive_distance);
+  fit->setSymmetric(sq_param_.symmetric);
+  if(!moment_table_.empty())
+    fit->setMomentTable(&moment_table_);
+  if(sq_param_.support_plane != "none" && table_plane_.size() == 4)
+    fit->setSupportPlane(Eigen::Vector4d(table_plane_[0], table_plane_[1], table_plane_[2], table_plane_[3]),
+                         sq_param_.support_plane == "tangent");
+  if(normals)
+    fit->setNormals(normals, sq_param_.normal_weight);
+  if(guess)
+    fit->setInitialGuess(*guess);
+}
 
-  std::unique_ptr<SuperquadricSampling> samp(new SuperquadricSampling(min_param));
+void SQFitter::fillReport(SuperquadricFitting& fit, const sq_fitting::sq& param, sq_fitting::fitReport& report)
+{
+  SuperquadricFitting::FitReport fit_report;
+  fit.getReport(fit_report);
+  report.sq = param;
+  report.iterations = fit_report.iterations;
+  report.function_evaluations = fit_report.function_evaluations;
+  report.jacobian_evaluations = fit_report.jacobian_evaluations;
+  report.final_error = fit_report.final_error;
+  report.termination = fit_report.termination;
+  report.prealign_time = fit_report.prealign_time;
+  report.lm_time = fit_report.lm_time;
+  report.error_time = fit_report.error_time;
+  report.primitive_time = fit_report.primitive_time;
+  report.primitive = fit_report.primitive;
+  report.n_points = fit_report.n_points;
+}
+
+void SQFitter::sampleTh(const sq_fitting::sq& param, ParamMultiVector& pvector)
+{
+  std::unique_ptr<SuperquadricSampling> samp(new SuperquadricSampling(param));
   CloudPtr sq_cloud(new PointCloud);
   samp->sample_pilu_fisher();
   samp->getCloud(sq_cloud);
   std::lock_guard<std::mutex> blck(mu_);
-  pvector.push_back(std::make_pair(min_param, sq_cloud));
+  pvector.push_back(std::make_pair(param, sq_cloud));
+}
+
+void SQFitter::fitAndSampleTh(CloudPtr &cloud_in,std::string& method, const sq_fitting::sq* guess,
+                              const pcl::PointCloud<pcl::Normal>::ConstPtr& normals, sq::FittingContext* context,
+                              sq_fitting::sq& fitted_param, sq_fitting::fitReport& report, ParamMultiVector& pvector){
+  std::unique_ptr<SuperquadricFitting> fit;
+  createFitting(cloud_in, method, guess, normals, context, fit);
+  fit->fit();
+  sq_fitting::sq min_param;
+  fit->getMinParams(min_param);
+  fitted_param = min_param;
+  fillReport(*fit, min_param, report);
+  sampleTh(min_param, pvector);
+}
+
+void SQFitter::fitScheduled(std::vector<CloudPtr>& objs, const std::vector<const sq_fitting::sq*>& guesses,
+                            const std::vector<pcl::PointCloud<pcl::Normal>::ConstPtr>& normals,
+                            const std::chrono::steady_clock::time_point& deadline,
+                            std::vector<sq_fitting::sq>& fitted_params)
+{
+  //iterations of an object per round, the deadline is checked before each of them
+  const int iterations_per_step = 5;
+  const size_t n = objs.size();
+  if(sq_param_.fitting_precision == "float")
+    ROS_WARN_ONCE("fitting_precision float is not used with fit_deadline, the objects are fitted in double precision");
+  std::vector<std::unique_ptr<SuperquadricFitting> > fits(n);
+  std::vector<char> finished(n, 0);
+  sq::ThreadPool& pool = sq::ThreadPool::instance();
+  pool.run(n, [&](size_t i)
+  {
+    createFitting(objs[i], sq_param_.pose_est_method, guesses[i], normals[i], contexts_[i].get(), fits[i]);
+    fits[i]->initStep();
+  });
+
+  //interleave steps of all unfinished objects, so that a slow object does not delay the others
+  std::vector<size_t> active(n);
+  for(size_t i=0;i<n;++i)
+    active[i] = i;
+  while(!active.empty() && std::chrono::steady_clock::now() < deadline)
+  {
+    pool.run(active.size(), [&](size_t k)
+    {
+      //an object queued behind slower ones does not start iterating past the deadline
+      bool done = false;
+      for(int j=0;j<iterations_per_step && !done && std::chrono::steady_clock::now() < deadline;++j)
+        done = fits[active[k]]->step(1);
+      finished[active[k]] = done;
+    });
+    std::vector<size_t> still_active;
+    for(size_t k=0;k<active.size();++k)
+    {
+      if(!finished[active[k]])
+        still_active.push_back(active[k]);
+    }
+    active.swap(still_active);
+  }
+
+  for(size_t i=0;i<n;++i)
+  {
+    if(finished[i])
+      fits[i]->getMinParams(fitted_params[i]);
+    else
+      fits[i]->getCurrentBest(fitted_params[i]);
+    fillReport(*fits[i], fitted_params[i], fit_reports_.reports[i]);
+    if(!finished[i])
+      fit_reports_.reports[i].termination = "deadline";
+  }
+  if(!active.empty())
+    ROS_WARN("%lu of %lu objects did not converge before the fitting deadline", active.size(), n);
+}
+
+void SQFitter::associateObjects(const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& centroids,
+                                std::vector<const sq_fitting::sq*>& guesses)
+{
+  guesses.assign(centroids.size(), NULL);
+  std::vector<bool> used(tracked_objects_.size(), false);
+  for(size_t i=0;i<centroids.size();++i)
+  {
+    double min_distance = sq_param_.warm_start_distance;
+    int min_index = -1;
+    for(size_t j=0;j<tracked_objects_.size();++j)
+    {
+      double distance = (tracked_objects_[j].centroid - centroids[i]).norm();
+      if(!used[j] && distance < min_distance)
+      {
+        min_distance = distance;
+        min_index = j;
+      }
+    }
+    if(min_index >= 0)
+    {
+      used[min_index] = true;
+      guesses[i] = &tracked_objects_[min_index].param;
+    }
+  }
 }
 
 void SQFitter::fitAndSample(std::vector<CloudPtr>& objs, ParamMultiVector& pvector){
@@ -347,15 +553,75 @@ void SQFitter::fitAndSample(std::vector<CloudPtr>& objs, ParamMultiVector& pvect
   pvector.reserve(objs.size());
   poseArr_.poses.resize(0);
   sqArr_.sqs.resize(0);
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > centroids(objs.size());
+  for(size_t i=0;i<objs.size();++i)
+    sq::getCenter(*objs[i], centroids[i](0), centroids[i](1), centroids[i](2));
+  std::vector<const sq_fitting::sq*> guesses(objs.size(), NULL);
+  if(sq_param_.warm_start)
+    associateObjects(centroids, guesses);
+  std::vector<pcl::PointCloud<pcl::Normal>::ConstPtr> normals(objs.size());
+  if(&objs == &Objects_ && object_normals_.size() == objs.size())
+    normals.assign(object_normals_.begin(), object_normals_.end());
+
+  std::vector<sq_fitting::sq> fitted_params(objs.size());
+  fit_reports_.reports.resize(objs.size());
+  //objects are fitted concurrently, each in its own context
+  while(contexts_.size() < objs.size())
+    contexts_.push_back(std::unique_ptr<sq::FittingContext>(new sq::FittingContext));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   std::vector<std::thread> threads;
-  for(int i=0;i<this->Objects_.size();++i)
+  if(sq_param_.fit_deadline > 0 && sq_param_.fitting_method != "ransac")
   {
-    threads.push_back(std::thread(&SQFitter::fitAndSampleTh, this, std::ref(objs[i]),
-                      std::ref(sq_param_.pose_est_method),std::ref(pvector)));
+    std::chrono::steady_clock::time_point deadline =
+        start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(sq_param_.fit_deadline));
+    fitScheduled(objs, guesses, normals, deadline, fitted_params);
+    for(size_t i=0;i<objs.size();++i)
+      threads.push_back(std::thread(&SQFitter::sampleTh, this, std::cref(fitted_params[i]), std::ref(pvector)));
+  }
+  else
+  {
+    for(size_t i=0;i<objs.size();++i)
+    {
+      threads.push_back(std::thread(&SQFitter::fitAndSampleTh, this, std::ref(objs[i]),
+                        std::ref(sq_param_.pose_est_method), guesses[i], std::cref(normals[i]),
+                        contexts_[i].get(), std::ref(fitted_params[i]),
+                        std::ref(fit_reports_.reports[i]), std::ref(pvector)));
+    }
   }
   for(auto &t:threads)
     t.join();
 
+  fit_reports_.fit_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fit_reports_.slowest = -1;
+  double max_time = -1;
+  for(size_t i=0;i<fit_reports_.reports.size();++i)
+  {
+    const sq_fitting::fitReport& report = fit_reports_.reports[i];
+    const double time = report.prealign_time + report.primitive_time + report.lm_time + report.error_time;
+    if(time > max_time)
+    {
+      max_time = time;
+      fit_reports_.slowest = i;
+    }
+  }
+  fit_reports_.header.frame_id = output_frame_;
+  fit_reports_.header.stamp = ros::Time::now();
+  fit_reports_pub_.publish(fit_reports_);
+  if(fit_reports_.slowest >= 0)
+  {
+    const sq_fitting::fitReport& slowest = fit_reports_.reports[fit_reports_.slowest];
+    ROS_DEBUG("Fitted in %f s, slowest object %d: %d points, %d iterations, %s", fit_reports_.fit_time,
+              fit_reports_.slowest, slowest.n_points, slowest.iterations, slowest.termination.c_str());
+  }
+
+  tracked_objects_.resize(objs.size());
+  for(size_t i=0;i<objs.size();++i)
+  {
+    tracked_objects_[i].param = fitted_params[i];
+    tracked_objects_[i].centroid = centroids[i];
+  }
+
   CloudPtr sq_cloud_pcl(new PointCloud);
   for(ParamMultiVector::iterator it = pvector.begin(); it !=pvector.end();++it){
     *sq_cloud_pcl+=*(it->second);
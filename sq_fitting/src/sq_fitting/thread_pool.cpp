@@ -0,0 +1,108 @@
+#include <sq_fitting/thread_pool.h>
+#include <algorithm>
+
+namespace sq {
+
+ThreadPool::ThreadPool(const unsigned n_workers) : stop_(false)
+{
+  for(unsigned i=0;i<n_workers;++i)
+    workers_.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for(auto &t:workers_)
+    t.join();
+}
+
+ThreadPool& ThreadPool::instance()
+{
+  static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+  return pool;
+}
+
+unsigned ThreadPool::size() const
+{
+  return workers_.size() + 1;
+}
+
+void ThreadPool::run(const std::size_t n, const std::function<void (std::size_t)> &task)
+{
+  if(n == 0)
+    return;
+  Batch batch;
+  batch.task = &task;
+  batch.n = n;
+  batch.next = 0;
+  batch.done = 0;
+  batch.users = 0;
+  if(n > 1 && !workers_.empty())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      batches_.push_back(&batch);
+    }
+    wake_.notify_all();
+  }
+  runBatch(batch);
+
+  //no worker can pick the batch once it is out of the queue, wait for the ones holding it
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::deque<Batch*>::iterator it = std::find(batches_.begin(), batches_.end(), &batch);
+    if(it != batches_.end())
+      batches_.erase(it);
+  }
+  std::unique_lock<std::mutex> lock(batch.mutex);
+  batch.finished.wait(lock, [&batch]{return batch.done == batch.n && batch.users == 0;});
+}
+
+std::size_t ThreadPool::chunkCount(const std::size_t n, const std::size_t chunk_size)
+{
+  return std::max<std::size_t>(1, (n + chunk_size - 1) / chunk_size);
+}
+
+void ThreadPool::runBatch(Batch &batch)
+{
+  for(std::size_t i = batch.next++; i < batch.n; i = batch.next++)
+  {
+    (*batch.task)(i);
+    if(++batch.done == batch.n)
+    {
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      batch.finished.notify_all();
+    }
+  }
+}
+
+void ThreadPool::workerLoop()
+{
+  while(true)
+  {
+    Batch* batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]{return stop_ || !batches_.empty();});
+      if(batches_.empty())
+        return;
+      batch = batches_.front();
+      if(batch->next >= batch->n)
+      {
+        batches_.pop_front();
+        continue;
+      }
+      ++batch->users;
+    }
+    runBatch(*batch);
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    --batch->users;
+    batch->finished.notify_all();
+  }
+}
+
+}//end of namespace
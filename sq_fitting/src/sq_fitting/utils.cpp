@@ -1,4 +1,10 @@
 #include<sq_fitting/utils.h>
+#include<sq_fitting/thread_pool.h>
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
 //#include <ceres/jet.h>
 
 
@@ -20,16 +26,17 @@ void sq_clampParameters(double& e1_clamped, double& e2_clamped)
 }
 
 
-double sq_function(const PointT& point, const sq_fitting::sq &param)
+template<typename PointType>
+double sq_function(const PointType& point, const sq_fitting::sq &param)
 {
   double e1_clamped = param.e1;
   double e2_clamped = param.e2;
   sq_clampParameters(e1_clamped, e2_clamped);
-  double t1 = pow(std::abs(point.x / param.a1), 2.0/e2_clamped);
-  double t2 = pow(std::abs(point.y / param.a2), 2.0/e2_clamped);
-  double t3 = pow(std::abs(point.z / param.a3), 2.0/e1_clamped);
-  double f = pow(std::abs(t1+t2), e2_clamped/e1_clamped) + t3;
-  return (pow(f,e1_clamped) - 1.0 );
+  double t1 = sq_kernel_pow(point.x / param.a1, 2.0/e2_clamped);
+  double t2 = sq_kernel_pow(point.y / param.a2, 2.0/e2_clamped);
+  double t3 = sq_kernel_pow(point.z / param.a3, 2.0/e1_clamped);
+  double f = sq_kernel_pow(t1+t2, e2_clamped/e1_clamped) + t3;
+  return (sq_kernel_pow(f, e1_clamped) - 1.0 );
 }
 
 double sq_function(const double &x, const double &y, const double &z, const double &a, const double &b, const double &c, const double &e1,
@@ -40,45 +47,562 @@ double sq_function(const double &x, const double &y, const double &z, const doub
   sq_clampParameters(e1_clamped, e2_clamped);
 
   //std::cout<<"e1: "<<e1_clamped<<" e2: "<<e2_clamped<<std::endl;
-  double t1 = pow(std::abs(x / a), 2.0/e2_clamped);
-  double t2 = pow(std::abs(y / b), 2.0/e2_clamped);
-  double t3 = pow(std::abs(z / c), 2.0/e1_clamped);
-  double f = pow(std::abs(t1+t2), e2_clamped/e1_clamped) + t3;
-  double value = (pow(f, e1_clamped/2.0) - 1.0) * pow(a * b * c, 0.25);
+  double t1 = sq_kernel_pow(x / a, 2.0/e2_clamped);
+  double t2 = sq_kernel_pow(y / b, 2.0/e2_clamped);
+  double t3 = sq_kernel_pow(z / c, 2.0/e1_clamped);
+  double f = sq_kernel_pow(t1+t2, e2_clamped/e1_clamped) + t3;
+  double value = (sq_kernel_pow(f, e1_clamped/2.0) - 1.0) * sq_kernel_pow(a * b * c, 0.25);
   return (value);
 
 }
 
 
-double sq_function_scale_weighting(const PointT& point, const sq_fitting::sq &param)
+template<typename PointType>
+double sq_function_scale_weighting(const PointType& point, const sq_fitting::sq &param)
 {
   double e1_clamped = param.e1;
   double e2_clamped = param.e2;
   sq_clampParameters(e1_clamped, e2_clamped);
-  double t1 = pow(std::abs(point.x / param.a1), 2.0/e2_clamped);
-  double t2 = pow(std::abs(point.y /param.a2), 2.0/e2_clamped);
-  double t3 = pow(std::abs(point.z /param.a3), 2.0/e1_clamped);
-  double f = pow(std::abs(t1+t2), e2_clamped/e1_clamped) + t3;
-  return (pow(f, e1_clamped/2.0) - 1.0) * pow(param.a1 * param.a2 * param.a3, 0.25);
+  double t1 = sq_kernel_pow(point.x / param.a1, 2.0/e2_clamped);
+  double t2 = sq_kernel_pow(point.y /param.a2, 2.0/e2_clamped);
+  double t3 = sq_kernel_pow(point.z /param.a3, 2.0/e1_clamped);
+  double f = sq_kernel_pow(t1+t2, e2_clamped/e1_clamped) + t3;
+  return (sq_kernel_pow(f, e1_clamped/2.0) - 1.0) * sq_kernel_pow(param.a1 * param.a2 * param.a3, 0.25);
 }
 
-double sq_error(const pcl::PointCloud<PointT>::Ptr cloud, const sq_fitting::sq &param)
+double sq_radial_residual(const double &x, const double &y, const double &z, const double &a, const double &b, const double &c,
+                          const double &e1, const double &e2, double* grad_point, double* grad_shape)
+{
+  double e1_clamped = e1;
+  double e2_clamped = e2;
+  sq_clampParameters(e1_clamped, e2_clamped);
+
+  double ax = std::abs(x / a);
+  double by = std::abs(y / b);
+  double cz = std::abs(z / c);
+  double t1 = pow(ax, 2.0/e2_clamped);
+  double t2 = pow(by, 2.0/e2_clamped);
+  double t3 = pow(cz, 2.0/e1_clamped);
+  double u = t1 + t2;
+  double g = pow(u, e2_clamped/e1_clamped);
+  double f = g + t3;
+  double fp = pow(f, e1_clamped/2.0);
+  double s = pow(a * b * c, 0.25);
+  double op = sqrt(x * x + y * y + z * z);
+  double F = fp - 1.0;
+  double value = op * F * s;
+
+  if(grad_point == NULL && grad_shape == NULL)
+    return (value);
+
+  //chain rule through f = (t1 + t2)^(e2/e1) + t3, guarding the zero limits
+  double dF_df = (f > 0.0) ? (e1_clamped / 2.0) * fp / f : 0.0;
+  double dg_du = (u > 0.0) ? (e2_clamped / e1_clamped) * g / u : 0.0;
+  double dt1_dx = (x != 0.0) ? (2.0/e2_clamped) * t1 / x : 0.0;
+  double dt2_dy = (y != 0.0) ? (2.0/e2_clamped) * t2 / y : 0.0;
+  double dt3_dz = (z != 0.0) ? (2.0/e1_clamped) * t3 / z : 0.0;
+
+  if(grad_point != NULL)
+  {
+    double dF_dx = dF_df * dg_du * dt1_dx;
+    double dF_dy = dF_df * dg_du * dt2_dy;
+    double dF_dz = dF_df * dt3_dz;
+    double w = (op > 0.0) ? F * s / op : 0.0;
+    grad_point[0] = x * w + op * s * dF_dx;
+    grad_point[1] = y * w + op * s * dF_dy;
+    grad_point[2] = z * w + op * s * dF_dz;
+  }
+
+  if(grad_shape != NULL)
+  {
+    double dF_da = -dF_df * dg_du * (2.0/e2_clamped) * t1 / a;
+    double dF_db = -dF_df * dg_du * (2.0/e2_clamped) * t2 / b;
+    double dF_dc = -dF_df * (2.0/e1_clamped) * t3 / c;
+    grad_shape[0] = op * s * dF_da + 0.25 * value / a;
+    grad_shape[1] = op * s * dF_db + 0.25 * value / b;
+    grad_shape[2] = op * s * dF_dc + 0.25 * value / c;
+
+    double t1_log = (t1 > 0.0) ? t1 * log(ax) : 0.0;
+    double t2_log = (t2 > 0.0) ? t2 * log(by) : 0.0;
+    double t3_log = (t3 > 0.0) ? t3 * log(cz) : 0.0;
+    double g_log = (g > 0.0) ? g * log(u) : 0.0;
+    double fp_log = (f > 0.0) ? fp * log(f) : 0.0;
+
+    double dg_de2 = dg_du * (-2.0/(e2_clamped * e2_clamped)) * (t1_log + t2_log) + g_log / e1_clamped;
+    double df_de1 = -g_log * e2_clamped / (e1_clamped * e1_clamped) - 2.0/(e1_clamped * e1_clamped) * t3_log;
+    double dF_de1 = dF_df * df_de1 + fp_log / 2.0;
+    double dF_de2 = dF_df * dg_de2;
+    grad_shape[3] = (e1_clamped == e1) ? op * s * dF_de1 : 0.0;
+    grad_shape[4] = (e2_clamped == e2) ? op * s * dF_de2 : 0.0;
+  }
+  return (value);
+}
+
+template<typename PointType>
+double sq_error(const pcl::PointCloud<PointType>& cloud, const sq_fitting::sq &param)
+{
+  PointBuffer points;
+  cloudToBuffer(cloud, Eigen::Affine3d::Identity(), points);
+  return sq_error(points, param);
+}
+
+/**
+ * @brief kernel parameter of a superquadric message
+ */
+static void create_kernel_param(const sq_fitting::sq &param, SQKernelParam& kernel_param)
 {
   Eigen::Affine3f transform;
   sq_create_transform(param.pose, transform);
-  pcl::PointCloud<PointT>::Ptr new_cloud(new pcl::PointCloud<PointT>);
-  pcl::transformPointCloud(*cloud, *new_cloud, transform);
-  double error = 0.0;
-  for(size_t i = 0;i<new_cloud->size();++i)
+  sq_kernel_param(param.a1, param.a2, param.a3, param.e1, param.e2, kernel_param);
+  Eigen::Matrix3d rotation = transform.rotation().cast<double>();
+  Eigen::Vector3d translation = transform.translation().cast<double>();
+  sq_kernel_set_transform(rotation.data(), translation.data(), kernel_param);
+}
+
+///chunks whose sums are kept on the stack, larger clouds allocate them
+static const size_t STACK_CHUNKS = 32;
+
+double sq_error(const PointBuffer &points, const sq_fitting::sq &param)
+{
+  SQKernelParam kernel_param;
+  create_kernel_param(param, kernel_param);
+  const size_t n_chunks = ThreadPool::chunkCount(points.size(), SQ_POINT_CHUNK_SIZE);
+  double stack_sums[STACK_CHUNKS];
+  std::vector<double> heap_sums(n_chunks > STACK_CHUNKS ? n_chunks : 0);
+  double* sums = heap_sums.empty() ? stack_sums : heap_sums.data();
+  ThreadPool::instance().runChunks(points.size(), SQ_POINT_CHUNK_SIZE, SQ_PARALLEL_POINTS,
+                                   [&](size_t chunk, size_t begin, size_t end)
   {
-    double op = sq_normPoint(new_cloud->at(i));
-    double val = op * sq_function_scale_weighting(new_cloud->at(i), param);
-    error += val * val;
-  }
-  error /= new_cloud->size();
+    sums[chunk] = sq_batch_squared_error(points.x.data() + begin, points.y.data() + begin, points.z.data() + begin,
+                                         end - begin, kernel_param);
+  });
+  double error = 0;
+  for(size_t i=0;i<n_chunks;++i)
+    error += sums[i];
+  error /= points.size();
   return error;
 }
 
+double sq_error(const PointBuffer &points, const sq_fitting::sq &param, const double abandon_error)
+{
+  //points summed between two checks of the bound
+  const size_t block_size = 1024;
+  SQKernelParam kernel_param;
+  create_kernel_param(param, kernel_param);
+  const size_t n = points.size();
+  const double abandon_sum = abandon_error * n;
+  double sum = 0;
+  for(size_t i = 0;i<n && sum < abandon_sum;i += block_size)
+  {
+    const size_t block = std::min(block_size, n - i);
+    sum += sq_batch_squared_error(points.x.data() + i, points.y.data() + i, points.z.data() + i, block, kernel_param);
+  }
+  return sum / n;
+}
+
+/**
+ * @brief copies the selected entries of a buffer, in order
+ */
+static void gatherBuffer(const PointBuffer &src, const std::vector<size_t> &selected, PointBuffer &dst)
+{
+  dst.x.resize(selected.size());
+  dst.y.resize(selected.size());
+  dst.z.resize(selected.size());
+  for(size_t i = 0;i<selected.size();++i)
+  {
+    dst.x[i] = src.x[selected[i]];
+    dst.y[i] = src.y[selected[i]];
+    dst.z[i] = src.z[selected[i]];
+  }
+}
+
+void downsampleBuffer(const PointBuffer &points, const size_t max_points, PointBuffer &downsampled)
+{
+  downsampleBuffer(points, NULL, max_points, downsampled, NULL);
+}
+
+void downsampleBuffer(const PointBuffer &points, const PointBuffer *normals, const size_t max_points,
+                      PointBuffer &downsampled, PointBuffer *downsampled_normals)
+{
+  const bool with_normals = normals && downsampled_normals && normals->size() == points.size() &&
+                            !normals->x.empty();
+  if(downsampled_normals && !with_normals)
+  {
+    downsampled_normals->x.clear();
+    downsampled_normals->y.clear();
+    downsampled_normals->z.clear();
+  }
+  const size_t n = points.size();
+  if(n <= max_points)
+  {
+    downsampled = points;
+    if(with_normals)
+      *downsampled_normals = *normals;
+    return;
+  }
+  //non finite points are skipped, their voxel indices would be undefined
+  std::vector<size_t> selected;
+  Eigen::Vector3d min_pt = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d max_pt = -min_pt;
+  for(size_t i = 0;i<n;++i)
+  {
+    if(!std::isfinite(points.x[i]) || !std::isfinite(points.y[i]) || !std::isfinite(points.z[i]))
+      continue;
+    const Eigen::Vector3d p(points.x[i], points.y[i], points.z[i]);
+    if(selected.empty())
+      selected.push_back(i);
+    min_pt = min_pt.cwiseMin(p);
+    max_pt = max_pt.cwiseMax(p);
+  }
+  const Eigen::Vector3d extent = max_pt - min_pt;
+  //without finite points or with all of them at the same position there is no leaf size, the
+  //output is the first finite point if any
+  if(selected.empty() || !(extent.maxCoeff() > 0))
+  {
+    gatherBuffer(points, selected, downsampled);
+    if(with_normals)
+      gatherBuffer(*normals, selected, *downsampled_normals);
+    return;
+  }
+
+  //objects are surfaces, so the number of occupied voxels grows with the area over leaf^2.
+  //Start below the estimate and grow the leaf, voxel indices are kept within 21 bits
+  const double area = 2. * (extent(0) * extent(1) + extent(1) * extent(2) + extent(0) * extent(2));
+  double leaf = std::max(0.5 * sqrt(area / max_points), extent.maxCoeff() / (1 << 20));
+  std::unordered_set<uint64_t> voxels;
+  while(true)
+  {
+    voxels.clear();
+    selected.clear();
+    for(size_t i = 0;i<n && selected.size() <= max_points;++i)
+    {
+      if(!std::isfinite(points.x[i]) || !std::isfinite(points.y[i]) || !std::isfinite(points.z[i]))
+        continue;
+      const uint64_t ix = static_cast<uint64_t>((points.x[i] - min_pt(0)) / leaf);
+      const uint64_t iy = static_cast<uint64_t>((points.y[i] - min_pt(1)) / leaf);
+      const uint64_t iz = static_cast<uint64_t>((points.z[i] - min_pt(2)) / leaf);
+      if(voxels.insert((ix << 42) | (iy << 21) | iz).second)
+        selected.push_back(i);
+    }
+    if(selected.size() <= max_points)
+      break;
+    leaf *= 1.25;
+  }
+
+  gatherBuffer(points, selected, downsampled);
+  if(with_normals)
+    gatherBuffer(*normals, selected, *downsampled_normals);
+}
+
+/**
+ * @brief sums of a range of points relative to an origin, merged in chunk order
+ */
+struct StatisticsSums
+{
+  double sum[3];
+  ///xx, yy, zz, xy, xz, yz
+  double products[6];
+  double min[3];
+  double max[3];
+};
+
+template<typename PointType>
+static void accumulateStatistics(const pcl::PointCloud<PointType> &cloud, const size_t begin, const size_t end,
+                                 const Eigen::Vector3d& origin, StatisticsSums& sums)
+{
+  //points gathered from the array of structures at once, the reductions vectorize
+  const size_t block_size = 256;
+  double x[block_size], y[block_size], z[block_size];
+  for(int k=0;k<3;++k)
+  {
+    sums.sum[k] = 0;
+    sums.min[k] = std::numeric_limits<double>::max();
+    sums.max[k] = -std::numeric_limits<double>::max();
+  }
+  for(int k=0;k<6;++k)
+    sums.products[k] = 0;
+  for(size_t b=begin;b<end;b+=block_size)
+  {
+    const size_t n = std::min(block_size, end - b);
+    for(size_t i=0;i<n;++i)
+    {
+      const PointType& p = cloud.points[b + i];
+      x[i] = p.x - origin(0);
+      y[i] = p.y - origin(1);
+      z[i] = p.z - origin(2);
+    }
+    double sx = 0, sy = 0, sz = 0, sxx = 0, syy = 0, szz = 0, sxy = 0, sxz = 0, syz = 0;
+    double min_x = sums.min[0], min_y = sums.min[1], min_z = sums.min[2];
+    double max_x = sums.max[0], max_y = sums.max[1], max_z = sums.max[2];
+    for(size_t i=0;i<n;++i)
+    {
+      sx += x[i];
+      sy += y[i];
+      sz += z[i];
+      sxx += x[i] * x[i];
+      syy += y[i] * y[i];
+      szz += z[i] * z[i];
+      sxy += x[i] * y[i];
+      sxz += x[i] * z[i];
+      syz += y[i] * z[i];
+      min_x = std::min(min_x, x[i]);
+      min_y = std::min(min_y, y[i]);
+      min_z = std::min(min_z, z[i]);
+      max_x = std::max(max_x, x[i]);
+      max_y = std::max(max_y, y[i]);
+      max_z = std::max(max_z, z[i]);
+    }
+    sums.sum[0] += sx;
+    sums.sum[1] += sy;
+    sums.sum[2] += sz;
+    sums.products[0] += sxx;
+    sums.products[1] += syy;
+    sums.products[2] += szz;
+    sums.products[3] += sxy;
+    sums.products[4] += sxz;
+    sums.products[5] += syz;
+    sums.min[0] = min_x;
+    sums.min[1] = min_y;
+    sums.min[2] = min_z;
+    sums.max[0] = max_x;
+    sums.max[1] = max_y;
+    sums.max[2] = max_z;
+  }
+}
+
+template<typename PointType>
+void cloudStatistics(const pcl::PointCloud<PointType> &cloud, CloudStatistics &statistics)
+{
+  const size_t n = cloud.points.size();
+  statistics.n = n;
+  if(n == 0)
+  {
+    statistics.centroid.setZero();
+    statistics.covariance.setZero();
+    statistics.min.setZero();
+    statistics.max.setZero();
+    return;
+  }
+  //sums relative to the first point, so that the covariance does not cancel far from the origin
+  const Eigen::Vector3d origin(cloud.points[0].x, cloud.points[0].y, cloud.points[0].z);
+  const size_t n_chunks = ThreadPool::chunkCount(n, SQ_POINT_CHUNK_SIZE);
+  StatisticsSums stack_sums[STACK_CHUNKS];
+  std::vector<StatisticsSums> heap_sums(n_chunks > STACK_CHUNKS ? n_chunks : 0);
+  StatisticsSums* sums = heap_sums.empty() ? stack_sums : heap_sums.data();
+  ThreadPool::instance().runChunks(n, SQ_POINT_CHUNK_SIZE, SQ_PARALLEL_POINTS,
+                                   [&](size_t chunk, size_t begin, size_t end)
+  {
+    accumulateStatistics(cloud, begin, end, origin, sums[chunk]);
+  });
+  StatisticsSums& total = sums[0];
+  for(size_t c=1;c<n_chunks;++c)
+  {
+    for(int k=0;k<3;++k)
+    {
+      total.sum[k] += sums[c].sum[k];
+      total.min[k] = std::min(total.min[k], sums[c].min[k]);
+      total.max[k] = std::max(total.max[k], sums[c].max[k]);
+    }
+    for(int k=0;k<6;++k)
+      total.products[k] += sums[c].products[k];
+  }
+  const Eigen::Vector3d mean = Eigen::Vector3d(total.sum[0], total.sum[1], total.sum[2]) / n;
+  Eigen::Matrix3d products;
+  products << total.products[0], total.products[3], total.products[4],
+              total.products[3], total.products[1], total.products[5],
+              total.products[4], total.products[5], total.products[2];
+  statistics.centroid = origin + mean;
+  statistics.covariance = products / n - mean * mean.transpose();
+  statistics.min = origin + Eigen::Vector3d(total.min[0], total.min[1], total.min[2]);
+  statistics.max = origin + Eigen::Vector3d(total.max[0], total.max[1], total.max[2]);
+}
+
+void principalAxes(const Eigen::Matrix3d &matrix, Eigen::Vector3d &values, Eigen::Matrix3d &vectors)
+{
+  //trigonometric solution of the characteristic polynomial instead of the iterative solver
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+  solver.computeDirect(matrix);
+  //increasing order from the solver
+  values = solver.eigenvalues().reverse();
+  vectors.col(0) = solver.eigenvectors().col(2);
+  vectors.col(1) = solver.eigenvectors().col(1);
+  vectors.col(2) = vectors.col(0).cross(vectors.col(1));
+}
+
+/**
+ * @brief z of the cross product of b - o and c - o, positive for a counter clockwise turn
+ */
+static double turn(const Eigen::Vector2d &o, const Eigen::Vector2d &b, const Eigen::Vector2d &c)
+{
+  return (b(0) - o(0)) * (c(1) - o(1)) - (b(1) - o(1)) * (c(0) - o(0));
+}
+
+void convexHull2d(Points2d &points, Points2d &hull)
+{
+  //Akl-Toussaint heuristic: the points strictly inside the octagon of the extreme points along
+  //eight directions in counter clockwise order are not vertices, and most are dropped before sorting
+  if(points.size() > 8)
+  {
+    const double directions[8][2] = {{0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}};
+    size_t extreme[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    double extent[8];
+    for(int k=0;k<8;++k)
+      extent[k] = directions[k][0] * points[0](0) + directions[k][1] * points[0](1);
+    for(size_t i=1;i<points.size();++i)
+    {
+      for(int k=0;k<8;++k)
+      {
+        const double e = directions[k][0] * points[i](0) + directions[k][1] * points[i](1);
+        if(e > extent[k])
+        {
+          extent[k] = e;
+          extreme[k] = i;
+        }
+      }
+    }
+    //inwards normal and offset of every edge of the octagon, skipping repeated vertices
+    double edges[8][3];
+    int n_edges = 0;
+    for(int k=0;k<8;++k)
+    {
+      const Eigen::Vector2d& from = points[extreme[k]];
+      const Eigen::Vector2d& to = points[extreme[(k + 1) % 8]];
+      if(from == to)
+        continue;
+      edges[n_edges][0] = from(1) - to(1);
+      edges[n_edges][1] = to(0) - from(0);
+      edges[n_edges][2] = edges[n_edges][0] * from(0) + edges[n_edges][1] * from(1);
+      ++n_edges;
+    }
+    if(n_edges >= 3)
+    {
+      points.erase(std::remove_if(points.begin(), points.end(), [&edges, n_edges](const Eigen::Vector2d &p)
+      {
+        for(int k=0;k<n_edges;++k)
+        {
+          if(edges[k][0] * p(0) + edges[k][1] * p(1) <= edges[k][2])
+            return false;
+        }
+        return true;
+      }), points.end());
+    }
+  }
+
+  std::sort(points.begin(), points.end(), [](const Eigen::Vector2d &a, const Eigen::Vector2d &b)
+  {
+    return a(0) < b(0) || (a(0) == b(0) && a(1) < b(1));
+  });
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  if(points.size() < 3)
+  {
+    hull.assign(points.begin(), points.end());
+    return;
+  }
+  //lower chain from left to right, then upper chain from right to left
+  hull.resize(2 * points.size());
+  size_t k = 0;
+  for(size_t i=0;i<points.size();++i)
+  {
+    while(k >= 2 && turn(hull[k - 2], hull[k - 1], points[i]) <= 0)
+      --k;
+    hull[k++] = points[i];
+  }
+  const size_t lower = k + 1;
+  for(size_t i=points.size()-1;i>0;--i)
+  {
+    while(k >= lower && turn(hull[k - 2], hull[k - 1], points[i - 1]) <= 0)
+      --k;
+    hull[k++] = points[i - 1];
+  }
+  //the last vertex is the first one
+  hull.resize(k - 1);
+}
+
+bool minAreaRectangle(const Points2d &hull, Rectangle2d &rectangle)
+{
+  const size_t h = hull.size();
+  if(h == 0)
+    return false;
+  if(h < 3)
+  {
+    const Eigen::Vector2d side = hull[h - 1] - hull[0];
+    const double length = side.norm();
+    rectangle.center = 0.5 * (hull[0] + hull[h - 1]);
+    rectangle.axis = length > 0 ? Eigen::Vector2d(side / length) : Eigen::Vector2d::UnitX();
+    rectangle.half_extent << 0.5 * length, 0.;
+    return true;
+  }
+
+  //calipers at the vertices furthest along the edge, furthest from it and furthest behind it
+  size_t right = 0, top = 0, left = 0;
+  double min_area = std::numeric_limits<double>::max();
+  for(size_t i=0;i<h;++i)
+  {
+    const Eigen::Vector2d& base = hull[i];
+    const Eigen::Vector2d d = (hull[(i + 1) % h] - base).normalized();
+    //inwards normal of a counter clockwise edge
+    const Eigen::Vector2d n(-d(1), d(0));
+    if(i == 0)
+    {
+      for(size_t j=1;j<h;++j)
+      {
+        if(d.dot(hull[j]) > d.dot(hull[right]))
+          right = j;
+        if(n.dot(hull[j]) > n.dot(hull[top]))
+          top = j;
+        if(d.dot(hull[j]) < d.dot(hull[left]))
+          left = j;
+      }
+    }
+    //the extreme vertices turn with the edges, so every caliper goes around the hull once
+    while(d.dot(hull[(right + 1) % h]) > d.dot(hull[right]))
+      right = (right + 1) % h;
+    while(n.dot(hull[(top + 1) % h]) > n.dot(hull[top]))
+      top = (top + 1) % h;
+    while(d.dot(hull[(left + 1) % h]) < d.dot(hull[left]))
+      left = (left + 1) % h;
+
+    const double d_max = d.dot(hull[right]);
+    const double d_min = d.dot(hull[left]);
+    const double n_min = n.dot(base);
+    const double height = n.dot(hull[top]) - n_min;
+    const double area = (d_max - d_min) * height;
+    if(area < min_area)
+    {
+      min_area = area;
+      rectangle.center = 0.5 * (d_max + d_min) * d + (n_min + 0.5 * height) * n;
+      rectangle.axis = d;
+      rectangle.half_extent << 0.5 * (d_max - d_min), 0.5 * height;
+    }
+  }
+  return true;
+}
+
+void bufferToFloat(const PointBuffer &points, PointBufferf &points_f)
+{
+  points_f.x.assign(points.x.begin(), points.x.end());
+  points_f.y.assign(points.y.begin(), points.y.end());
+  points_f.z.assign(points.z.begin(), points.z.end());
+}
+
+template<typename PointType>
+void cloudToBuffer(const pcl::PointCloud<PointType> &cloud, const Eigen::Affine3d &transform, PointBuffer &buffer)
+{
+  const size_t n = cloud.points.size();
+  buffer.x.resize(n);
+  buffer.y.resize(n);
+  buffer.z.resize(n);
+  const Eigen::Matrix3d rotation = transform.rotation();
+  const Eigen::Vector3d translation = transform.translation();
+  for(size_t i = 0;i<n;++i)
+  {
+    Eigen::Vector3d p = rotation * Eigen::Vector3d(cloud.points[i].x, cloud.points[i].y, cloud.points[i].z) + translation;
+    buffer.x[i] = p[0];
+    buffer.y[i] = p[1];
+    buffer.z[i] = p[2];
+  }
+}
+
 void sq_create_transform(const geometry_msgs::Pose& pose, Eigen::Affine3f& transform)
 {
   transform = Eigen::Affine3f::Identity();
@@ -88,7 +612,8 @@ void sq_create_transform(const geometry_msgs::Pose& pose, Eigen::Affine3f& trans
   transform.rotate(q);
 }
 
-double sq_normPoint(const PointT &point)
+template<typename PointType>
+double sq_normPoint(const PointType &point)
 {
   double value = sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
   return value;
@@ -112,6 +637,17 @@ void create_transformation_matrix(const double tx, const double ty, const double
   trns_mat = translation_matrix*rot_matrix;// * translation_matrix;
 }
 
+void create_kernel_param(const Eigen::Ref<const Eigen::VectorXd> &xvec, SQKernelParam &param)
+{
+  sq_kernel_param(xvec[0], xvec[1], xvec[2], xvec[3], xvec[4], param);
+  Eigen::Affine3d trans;
+  create_transformation_matrix(xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10], trans);
+  //linear() is the rotation already, rotation() would run a polar decomposition on every call
+  Eigen::Matrix3d rotation = trans.linear();
+  Eigen::Vector3d translation = trans.translation();
+  sq_kernel_set_transform(rotation.data(), translation.data(), param);
+}
+
 void create_rotation_matrix(const double ax, const double ay, const double az, Eigen::Affine3d &rot_matrix)
 {
   Eigen::Affine3d rx = Eigen::Affine3d(Eigen::AngleAxisd(ax, Eigen::Vector3d(1,0,0)));
@@ -130,10 +666,11 @@ void getParamFromPose(const geometry_msgs::Pose &pose, double &tx, double &ty, d
   tx = t(0);
   ty = t(1);
   tz = t(2);
-  Eigen::Vector3d rot_angle = rot_matrix.eulerAngles(0,1,2);
+  //rotation of create_rotation_matrix is rx * rz * ry
+  Eigen::Vector3d rot_angle = rot_matrix.eulerAngles(0,2,1);
   ax = rot_angle[0] ;
-  ay = rot_angle[1] ;
-  az = rot_angle[2] ;
+  az = rot_angle[1] ;
+  ay = rot_angle[2] ;
 }
 
 
@@ -144,10 +681,10 @@ void getParamFromPose(const Eigen::Affine3d &trans, double &tx, double &ty, doub
   tx = t(0);
   ty = t(1);
   tz = t(2);
-  Eigen::Vector3d rot_angle = rot_matrix.eulerAngles(0,1,2);
+  Eigen::Vector3d rot_angle = rot_matrix.eulerAngles(0,2,1);
   ax = rot_angle[0] ;
-  ay = rot_angle[1] ;
-  az = rot_angle[2] ;
+  az = rot_angle[1] ;
+  ay = rot_angle[2] ;
 
 }
 
@@ -165,26 +702,27 @@ void Quaternion2Euler(const geometry_msgs::Pose &pose, double &ax, double &ay, d
 
 
 
-void getCenter(pcl::PointCloud<PointT>::Ptr& cloud_in, double& x, double& y, double& z)
+template<typename PointType>
+void getCenter(const pcl::PointCloud<PointType>& cloud_in, double& x, double& y, double& z)
 {
-  double val_x = cloud_in->points.at(0).x;
-  double val_y = cloud_in->points.at(0).y;
-  double val_z = cloud_in->points.at(0).z;
+  double val_x = cloud_in.points.at(0).x;
+  double val_y = cloud_in.points.at(0).y;
+  double val_z = cloud_in.points.at(0).z;
   double x_max = val_x, x_min = val_x, y_max = val_y, y_min = val_y, z_max = val_z, z_min = val_z;
-  for(int i=0;i<cloud_in->points.size();++i)
+  for(int i=0;i<cloud_in.points.size();++i)
   {
-    if (cloud_in->points.at(i).x>=x_max)
-      x_max = cloud_in->points.at(i).x;
-    if (cloud_in->points.at(i).x<=x_min)
-      x_min = cloud_in->points.at(i).x;
-    if (cloud_in->points.at(i).y>=y_max)
-      y_max = cloud_in->points.at(i).y;
-    if (cloud_in->points.at(i).y<=y_min)
-      y_min = cloud_in->points.at(i).y;
-    if (cloud_in->points.at(i).z>=z_max)
-      z_max = cloud_in->points.at(i).z;
-    if (cloud_in->points.at(i).z<=z_min)
-      z_min = cloud_in->points.at(i).z;
+    if (cloud_in.points.at(i).x>=x_max)
+      x_max = cloud_in.points.at(i).x;
+    if (cloud_in.points.at(i).x<=x_min)
+      x_min = cloud_in.points.at(i).x;
+    if (cloud_in.points.at(i).y>=y_max)
+      y_max = cloud_in.points.at(i).y;
+    if (cloud_in.points.at(i).y<=y_min)
+      y_min = cloud_in.points.at(i).y;
+    if (cloud_in.points.at(i).z>=z_max)
+      z_max = cloud_in.points.at(i).z;
+    if (cloud_in.points.at(i).z<=z_min)
+      z_min = cloud_in.points.at(i).z;
   }
   x = (x_max+x_min)/2;
   y = (y_max+y_min)/2;
@@ -193,202 +731,80 @@ void getCenter(pcl::PointCloud<PointT>::Ptr& cloud_in, double& x, double& y, dou
 }
 
 
-void getTransformPose(pcl::PointCloud<PointT>::Ptr& cloud_in, geometry_msgs::Pose &pose)
+/**
+ * @brief pose of the box of minimum volume enclosing the cloud with a side along height_axis,
+ * from the minimum area rectangle enclosing the cloud projected on the plane of the two other axes
+ */
+template<typename PointType>
+static void getPlanarPose(const pcl::PointCloud<PointType> &cloud, const int height_axis, geometry_msgs::Pose &pose)
 {
-
-  // Compute z height as maximum distance from planes
-  double val_z = cloud_in->points.at(0).z;
-  double  z_max = val_z, z_min = val_z;
-  for(int i=0;i<cloud_in->points.size();++i)
+  if(cloud.points.empty())
+    return;
+  //the plane axes follow the height axis cyclically, so the pose is right handed
+  const int u = (height_axis + 1) % 3;
+  const int v = (height_axis + 2) % 3;
+  Points2d projected(cloud.points.size());
+  double height_min = std::numeric_limits<double>::max();
+  double height_max = -height_min;
+  for(size_t i=0;i<cloud.points.size();++i)
   {
-    if (cloud_in->points.at(i).z>=z_max)
-      z_max = cloud_in->points.at(i).z;
-    if (cloud_in->points.at(i).z<=z_min)
-      z_min = cloud_in->points.at(i).z;
+    const double p[3] = {cloud.points[i].x, cloud.points[i].y, cloud.points[i].z};
+    projected[i] << p[u], p[v];
+    height_min = std::min(height_min, p[height_axis]);
+    height_max = std::max(height_max, p[height_axis]);
   }
-
-  double height = z_max -z_min;
-  double min_volume = std::numeric_limits<double>::max();
-  Eigen::Matrix3f transformation;
-  // Find the convex hull
-  pcl::PointCloud<pcl::PointXYZRGB> hull;
-  pcl::ConvexHull<pcl::PointXYZRGB> convex_hull;
-  convex_hull.setInputCloud(cloud_in);
-  convex_hull.setDimension(2);
-  convex_hull.reconstruct(hull);
-
-  // Try fitting a rectangle
-  for (size_t i = 0; i < hull.size() - 1; ++i) {
-  // For each pair of hull points, determine the angle
-    double rise = hull[i + 1].y - hull[i].y;
-    double run = hull[i + 1].x - hull[i].x;
-    // and normalize..
-    {
-      double l = sqrt((rise * rise) + (run * run));
-      rise = rise / l;
-      run = run / l;
-     }
-
-    // Build rotation matrix from change of basis
-    Eigen::Matrix3f rotation;
-    rotation(0, 0) = run;
-    rotation(0, 1) = rise;
-    rotation(0, 2) = 0.0;
-    rotation(1, 0) = -rise;
-    rotation(1, 1) = run;
-    rotation(1, 2) = 0.0;
-    rotation(2, 0) = 0.0;
-    rotation(2, 1) = 0.0;
-    rotation(2, 2) = 1.0;
-    Eigen::Matrix3f inv_rotation = rotation.inverse();
-
-    // Project hull to new coordinate system
-    pcl::PointCloud<pcl::PointXYZRGB> projected_cloud;
-    for (size_t j = 0; j < hull.size(); ++j)
-    {
-        pcl::PointXYZRGB p;
-        p.getVector3fMap() = rotation * hull[j].getVector3fMap();
-        projected_cloud.push_back(p);
-    }
-
-    // Compute min/max
-    double x_min = std::numeric_limits<double>::max();
-    double x_max = std::numeric_limits<double>::min();
-    double y_min = std::numeric_limits<double>::max();
-    double y_max = std::numeric_limits<double>::min();
-    for (size_t j = 0; j < projected_cloud.size(); ++j)
-    {
-       if (projected_cloud[j].x < x_min) x_min = projected_cloud[j].x;
-       if (projected_cloud[j].x > x_max) x_max = projected_cloud[j].x;
-
-       if (projected_cloud[j].y < y_min) y_min = projected_cloud[j].y;
-       if (projected_cloud[j].y > y_max) y_max = projected_cloud[j].y;
-    }
-
-
-    // Is this the best estimate?
-    double area = (x_max - x_min) * (y_max - y_min);
-    if (area * height < min_volume)
-    {
-      //transformation = inv_plane_rotation * inv_rotation;
-      transformation = inv_rotation;
-      //dimensions->x = (x_max - x_min);
-     // dimensions->y = (y_max - y_min);
-      //dimensions->z = height;
-
-      Eigen::Vector3f pose3f((x_max + x_min) / 2.0, (y_max + y_min) / 2.0, projected_cloud[0].z + height / 2.0);
-      pose3f = transformation * pose3f;
-      pose.position.x = pose3f(0);
-      pose.position.y = pose3f(1);
-      pose.position.z = pose3f(2);
-      Eigen::Quaternionf q(transformation);
-      pose.orientation.x = q.x();
-      pose.orientation.y = q.y();
-      pose.orientation.z = q.z();
-      pose.orientation.w = q.w();
-      min_volume = area * height;
-    }
-   }
+  //the volume is the area of the rectangle times the height, the same for every rectangle
+  Points2d hull;
+  convexHull2d(projected, hull);
+  Rectangle2d rectangle;
+  minAreaRectangle(hull, rectangle);
+
+  Eigen::Matrix3d rotation = Eigen::Matrix3d::Zero();
+  rotation(u, u) = rectangle.axis(0);
+  rotation(v, u) = rectangle.axis(1);
+  rotation(u, v) = -rectangle.axis(1);
+  rotation(v, v) = rectangle.axis(0);
+  rotation(height_axis, height_axis) = 1.;
+  Eigen::Vector3d position;
+  position(u) = rectangle.center(0);
+  position(v) = rectangle.center(1);
+  position(height_axis) = 0.5 * (height_min + height_max);
+
+  pose.position.x = position(0);
+  pose.position.y = position(1);
+  pose.position.z = position(2);
+  const Eigen::Quaterniond q(rotation);
+  pose.orientation.x = q.x();
+  pose.orientation.y = q.y();
+  pose.orientation.z = q.z();
+  pose.orientation.w = q.w();
 }
 
-
-
-void getCompletePose(pcl::PointCloud<PointT>::Ptr& cloud_in, geometry_msgs::Pose &pose)
+template<typename PointType>
+void getTransformPose(const pcl::PointCloud<PointType>& cloud_in, geometry_msgs::Pose &pose)
 {
+  getPlanarPose(cloud_in, 2, pose);
+}
 
-  // Compute y height as maximum distance from planes
-  double val_x = cloud_in->points.at(0).x;
-  double  x_max = val_x, x_min = val_x;
-  for(int i=0;i<cloud_in->points.size();++i)
-  {
-    if (cloud_in->points.at(i).x>=x_max)
-      x_max = cloud_in->points.at(i).x;
-    if (cloud_in->points.at(i).x<=x_min)
-      x_min = cloud_in->points.at(i).x;
-  }
-
-  double height = x_max -x_min;
-  double min_volume = std::numeric_limits<double>::max();
-  Eigen::Matrix3f transformation;
-  // Find the convex hull
-  pcl::PointCloud<pcl::PointXYZRGB> hull;
-  pcl::ConvexHull<pcl::PointXYZRGB> convex_hull;
-  convex_hull.setInputCloud(cloud_in);
-  convex_hull.setDimension(2);
-  convex_hull.reconstruct(hull);
-
-  // Try fitting a rectangle
-  for (size_t i = 0; i < hull.size() - 1; ++i) {
-  // For each pair of hull points, determine the angle
-    double rise = hull[i + 1].y - hull[i].y;
-    double run = hull[i + 1].z - hull[i].z;
-    // and normalize..
-    {
-      double l = sqrt((rise * rise) + (run * run));
-      rise = rise / l;
-      run = run / l;
-     }
-
-    // Build rotation matrix from change of basis
-    Eigen::Matrix3f rotation;
-    rotation(0, 0) = run;
-    rotation(0, 1) = rise;
-    rotation(0, 2) = 0.0;
-    rotation(1, 0) = -rise;
-    rotation(1, 1) = run;
-    rotation(1, 2) = 0.0;
-    rotation(2, 0) = 0.0;
-    rotation(2, 1) = 0.0;
-    rotation(2, 2) = 1.0;
-    Eigen::Matrix3f inv_rotation = rotation.inverse();
-
-    // Project hull to new coordinate system
-    pcl::PointCloud<pcl::PointXYZRGB> projected_cloud;
-    for (size_t j = 0; j < hull.size(); ++j)
-    {
-        pcl::PointXYZRGB p;
-        p.getVector3fMap() = rotation * hull[j].getVector3fMap();
-        projected_cloud.push_back(p);
-    }
-
-    // Compute min/max
-    double y_min = std::numeric_limits<double>::max();
-    double y_max = std::numeric_limits<double>::min();
-    double z_min = std::numeric_limits<double>::max();
-    double z_max = std::numeric_limits<double>::min();
-    for (size_t j = 0; j < projected_cloud.size(); ++j)
-    {
-       if (projected_cloud[j].y < y_min) y_min = projected_cloud[j].y;
-       if (projected_cloud[j].y > y_max) y_max = projected_cloud[j].y;
-
-       if (projected_cloud[j].z < z_min) z_min = projected_cloud[j].z;
-       if (projected_cloud[j].z > z_max) z_max = projected_cloud[j].z;
-    }
-
-
-    // Is this the best estimate?
-    double area = (y_max - y_min) * (z_max - z_min);
-    if (area * height < min_volume)
-    {
-      //transformation = inv_plane_rotation * inv_rotation;
-      transformation = inv_rotation;
-      //dimensions->x = (x_max - x_min);
-     // dimensions->y = (y_max - y_min);
-      //dimensions->z = height;
-
-      Eigen::Vector3f pose3f(projected_cloud[0].x + height / 2.0,(y_max + y_min) / 2.0, (z_max + z_min) / 2.0);
-      pose3f = transformation * pose3f;
-      pose.position.x = pose3f(0);
-      pose.position.y = pose3f(1);
-      pose.position.z = pose3f(2);
-      Eigen::Quaternionf q(transformation);
-      pose.orientation.x = q.x();
-      pose.orientation.y = q.y();
-      pose.orientation.z = q.z();
-      pose.orientation.w = q.w();
-      min_volume = area * height;
-    }
-   }
+template<typename PointType>
+void getCompletePose(const pcl::PointCloud<PointType>& cloud_in, geometry_msgs::Pose &pose)
+{
+  getPlanarPose(cloud_in, 0, pose);
 }
 
+#define SQ_INSTANTIATE_UTILS(PointType) \
+  template void cloudToBuffer<PointType>(const pcl::PointCloud<PointType>&, const Eigen::Affine3d&, PointBuffer&); \
+  template void cloudStatistics<PointType>(const pcl::PointCloud<PointType>&, CloudStatistics&); \
+  template double sq_function<PointType>(const PointType&, const sq_fitting::sq&); \
+  template double sq_function_scale_weighting<PointType>(const PointType&, const sq_fitting::sq&); \
+  template double sq_error<PointType>(const pcl::PointCloud<PointType>&, const sq_fitting::sq&); \
+  template double sq_normPoint<PointType>(const PointType&); \
+  template void getCenter<PointType>(const pcl::PointCloud<PointType>&, double&, double&, double&); \
+  template void getTransformPose<PointType>(const pcl::PointCloud<PointType>&, geometry_msgs::Pose&); \
+  template void getCompletePose<PointType>(const pcl::PointCloud<PointType>&, geometry_msgs::Pose&);
+
+SQ_INSTANTIATE_UTILS(pcl::PointXYZ)
+SQ_INSTANTIATE_UTILS(pcl::PointXYZRGB)
+SQ_INSTANTIATE_UTILS(pcl::PointNormal)
+
 } //end of namespace
@@ -0,0 +1,139 @@
+#include<iostream>
+#include<sq_fitting/fitting.h>
+#include<sq_fitting/residual.h>
+#include<sq_fitting/sampling.h>
+#include<sq_fitting/sq.h>
+
+#include <pcl/point_types.h>
+#include<memory>
+#include<vector>
+typedef pcl::PointCloud<PointT>::Ptr pointCloudPtr;
+
+//Compares the analytic and autodiff jacobians of the fitting functor against the numerical one,
+//and the so3 rotation columns against rotating the superquadric by small rotation vectors
+
+pointCloudPtr create_sq_cloud(const double e1, const double e2)
+{
+  pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+  sq_fitting::sq super;
+  super.a1 = 0.05;
+  super.a2 = 0.08;
+  super.a3 = 0.12;
+  super.e1 = e1;
+  super.e2 = e2;
+  geometry_msgs::Pose pose;
+  pose.position.x = 0.3;
+  pose.position.y = -0.1;
+  pose.position.z = 0.9;
+  pose.orientation.w = 1.0;
+  super.pose = pose;
+  std::unique_ptr<SuperquadricSampling> samp(new SuperquadricSampling(super));
+  samp->sample_pilu_fisher();
+  samp->getCloud(cloud);
+
+  //keep the test fast
+  pointCloudPtr sub_cloud(new pcl::PointCloud<PointT>);
+  for(size_t i=0;i<cloud->points.size();i+=97)
+    sub_cloud->points.push_back(cloud->points[i]);
+  sub_cloud->width = sub_cloud->points.size();
+  sub_cloud->height = 1;
+  sub_cloud->is_dense = true;
+  return sub_cloud;
+}
+
+int main(int argc, char *argv[])
+{
+  double tolerance = 1e-4;
+  double shapes[3][2] = {{1.0, 1.0}, {0.3, 0.8}, {1.5, 0.2}};
+  bool passed = true;
+  for(int k=0;k<3;++k)
+  {
+    pointCloudPtr cloud = create_sq_cloud(shapes[k][0], shapes[k][1]);
+    SuperquadricFitting fit(cloud);
+    fit.set_pose_est_method("pca");
+
+    Eigen::VectorXd xvec(11);
+    xvec << 0.06, 0.07, 0.1, shapes[k][0] + 0.05, shapes[k][1] + 0.05, 0.01, -0.02, 0.005, 0.1, -0.2, 0.15;
+
+    //the double instantiation of the templated residual evaluates the kernel residual
+    sq::SQKernelParam param;
+    sq::create_kernel_param(xvec, param);
+    for(size_t i=0;i<cloud->points.size();++i)
+    {
+      double x = cloud->points[i].x, y = cloud->points[i].y, z = cloud->points[i].z;
+      double kernel_residual;
+      sq::sq_batch_radial_residual(&x, &y, &z, 1, param, &kernel_residual);
+      double residual = sq::sq_residual(xvec.data(), x, y, z);
+      if(std::abs(residual - kernel_residual) > 1e-9 * std::max(1.0, std::abs(kernel_residual)))
+      {
+        std::cout<<"e1: "<<shapes[k][0]<<" e2: "<<shapes[k][1]<<" residual "<<residual<<" kernel: "<<kernel_residual<<std::endl;
+        passed = false;
+      }
+    }
+
+    Eigen::MatrixXd jac_numerical;
+    fit.set_jacobian_method("numerical");
+    fit.getJacobian(xvec, jac_numerical);
+
+    const std::string methods[2] = {"analytic", "autodiff"};
+    for(int m=0;m<2;++m)
+    {
+      Eigen::MatrixXd jac;
+      fit.set_jacobian_method(methods[m]);
+      fit.getJacobian(xvec, jac);
+
+      //relative error per unknown, normalized by the column magnitude
+      for(int j=0;j<jac.cols();++j)
+      {
+        double scale = std::max(jac_numerical.col(j).cwiseAbs().maxCoeff(), 1e-12);
+        double error = (jac.col(j) - jac_numerical.col(j)).cwiseAbs().maxCoeff() / scale;
+        if(error > tolerance)
+        {
+          std::cout<<methods[m]<<" e1: "<<shapes[k][0]<<" e2: "<<shapes[k][1]<<" unknown "<<j<<" relative error: "<<error<<std::endl;
+          passed = false;
+        }
+      }
+    }
+
+    Eigen::MatrixXd jac_so3;
+    fit.set_jacobian_method("analytic");
+    fit.set_rotation("so3");
+    fit.getJacobian(xvec, jac_so3);
+    fit.set_rotation("euler");
+    pointCloudPtr prealigned;
+    fit.getPreAlignedCloud(prealigned);
+    const size_t n = prealigned->points.size();
+    std::vector<double> px(n), py(n), pz(n), plus(n), minus(n);
+    for(size_t i=0;i<n;++i)
+    {
+      px[i] = prealigned->points[i].x;
+      py[i] = prealigned->points[i].y;
+      pz[i] = prealigned->points[i].z;
+    }
+    Eigen::Affine3d transform;
+    sq::create_transformation_matrix(xvec[5], xvec[6], xvec[7], xvec[8], xvec[9], xvec[10], transform);
+    const Eigen::Vector3d translation = transform.translation();
+    const double h = 1e-6;
+    for(int j=0;j<3;++j)
+    {
+      Eigen::Matrix3d rotation = Eigen::AngleAxisd(h, Eigen::Vector3d::Unit(j)) * transform.linear();
+      sq::sq_kernel_set_transform(rotation.data(), translation.data(), param);
+      sq::sq_batch_radial_residual(px.data(), py.data(), pz.data(), n, param, plus.data());
+      rotation = Eigen::AngleAxisd(-h, Eigen::Vector3d::Unit(j)) * transform.linear();
+      sq::sq_kernel_set_transform(rotation.data(), translation.data(), param);
+      sq::sq_batch_radial_residual(px.data(), py.data(), pz.data(), n, param, minus.data());
+      Eigen::VectorXd column(n);
+      for(size_t i=0;i<n;++i)
+        column[i] = (plus[i] - minus[i]) / (2. * h);
+      double scale = std::max(column.cwiseAbs().maxCoeff(), 1e-12);
+      double error = (jac_so3.col(8 + j) - column).cwiseAbs().maxCoeff() / scale;
+      if(error > tolerance)
+      {
+        std::cout<<"so3 e1: "<<shapes[k][0]<<" e2: "<<shapes[k][1]<<" rotation "<<j<<" relative error: "<<error<<std::endl;
+        passed = false;
+      }
+    }
+  }
+  std::cout<<(passed ? "Analytic and autodiff jacobians match numerical jacobian" : "Jacobian mismatch")<<std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+#include<iostream>
+#include<sq_fitting/kernel.h>
+#include<sq_fitting/utils.h>
+
+#include<vector>
+#include<cmath>
+#include<cstdlib>
+#include<limits>
+
+//Compares every batch kernel supported by this cpu against sq::sq_radial_residual, the
+//powers of every kernel accuracy against std::pow, and the rotating calipers of
+//sq::minAreaRectangle against trying every hull edge
+
+double random_value(const double min, const double max)
+{
+  return min + (max - min) * static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
+}
+
+template<typename T>
+bool check_kernel(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z,
+                  const sq::SQKernelParam& param, const double tolerance)
+{
+  const size_t n = x.size();
+  std::vector<T> xs(x.begin(), x.end()), ys(y.begin(), y.end()), zs(z.begin(), z.end());
+  std::vector<T> inside_outside(n), residual(n), grad(sq::SQ_KERNEL_GRAD_SIZE * n);
+  sq::sq_batch_inside_outside(xs.data(), ys.data(), zs.data(), n, param, inside_outside.data());
+  sq::sq_batch_radial_residual(xs.data(), ys.data(), zs.data(), n, param, residual.data(), grad.data());
+  double squared_error = sq::sq_batch_squared_error(xs.data(), ys.data(), zs.data(), n, param);
+
+  Eigen::Matrix3d rotation;
+  Eigen::Vector3d translation;
+  for(int r=0;r<3;++r)
+  {
+    for(int c=0;c<3;++c)
+      rotation(r, c) = param.transform[4*r+c];
+    translation(r) = param.transform[4*r+3];
+  }
+
+  double max_error = 0.0;
+  double reference_squared_error = 0.0;
+  for(size_t i=0;i<n;++i)
+  {
+    Eigen::Vector3d w = rotation * Eigen::Vector3d(xs[i], ys[i], zs[i]);
+    Eigen::Vector3d p = w + translation;
+    Eigen::Vector3d grad_point;
+    double grad_shape[5];
+    double value = sq::sq_radial_residual(p[0], p[1], p[2], param.a1, param.a2, param.a3, param.e1, param.e2,
+                                          grad_point.data(), grad_shape);
+    reference_squared_error += value * value;
+    Eigen::Vector3d m = w.cross(grad_point);
+    double reference[sq::SQ_KERNEL_GRAD_SIZE] = {grad_shape[0], grad_shape[1], grad_shape[2], grad_shape[3], grad_shape[4],
+                                                 grad_point[0], grad_point[1], grad_point[2], m[0], m[1], m[2]};
+    double scale = std::max(1.0, std::abs(value));
+    max_error = std::max(max_error, std::abs(residual[i] - value) / scale);
+    for(int k=0;k<sq::SQ_KERNEL_GRAD_SIZE;++k)
+      max_error = std::max(max_error, std::abs(grad[k * n + i] - reference[k]) / std::max(1.0, std::abs(reference[k])));
+    double e1 = param.e1;
+    double e2 = param.e2;
+    sq::sq_clampParameters(e1, e2);
+    double f = pow(pow(std::abs(p[0] / param.a1), 2.0 / e2) + pow(std::abs(p[1] / param.a2), 2.0 / e2), e2 / e1) +
+        pow(std::abs(p[2] / param.a3), 2.0 / e1);
+    max_error = std::max(max_error, std::abs(inside_outside[i] - f) / std::max(1.0, f));
+  }
+  max_error = std::max(max_error, std::abs(squared_error - reference_squared_error) / std::max(1.0, reference_squared_error));
+  std::cout<<"kernel "<<sq::sq_kernel_type()<<" "<<sizeof(T) * 8<<" bit, max relative error: "<<max_error<<std::endl;
+  return max_error < tolerance;
+}
+
+bool check_pow(const sq::KernelAccuracy accuracy, const double tolerance)
+{
+  sq::sq_set_kernel_accuracy(accuracy);
+  //exponents 2/e2, 2/e1, e2/e1 and e1/2 of e in [0.1, 1.9]
+  const double exponents[] = {0.05, 0.25, 0.5, 0.7, 1.0, 1.05, 1.9, 2.0, 3.3, 7.0, 19.0, 20.0};
+  double max_error = 0.0;
+  for(int k=0;k<12;++k)
+  {
+    for(int i=0;i<=2000;++i)
+    {
+      const double x = std::pow(10.0, -4.0 + 6.0 * i / 2000.0);
+      const double p = exponents[k];
+      const double reference = std::pow(x, p);
+      if(reference < 1e-300 || reference > 1e300)
+        continue;
+      max_error = std::max(max_error, std::abs(sq::sq_kernel_pow(-x, p) - reference) / reference);
+    }
+    if(sq::sq_kernel_pow(0.0, exponents[k]) != 0.0)
+      max_error = 1.0;
+  }
+  std::cout<<"accuracy "<<accuracy<<", max relative error of the power: "<<max_error<<std::endl;
+  return max_error < tolerance;
+}
+
+bool check_rectangle(const size_t n, const double aspect, const double angle)
+{
+  sq::Points2d points(n);
+  const Eigen::Rotation2Dd rotation(angle);
+  for(size_t i=0;i<n;++i)
+    points[i] = rotation * Eigen::Vector2d(random_value(-aspect, aspect), random_value(-1., 1.));
+  const sq::Points2d input = points;
+  sq::Points2d hull;
+  sq::convexHull2d(points, hull);
+  sq::Rectangle2d rectangle;
+  if(!sq::minAreaRectangle(hull, rectangle))
+    return false;
+
+  //every edge against every input point
+  double min_area = std::numeric_limits<double>::max();
+  for(size_t i=0;i<hull.size();++i)
+  {
+    const Eigen::Vector2d d = (hull[(i + 1) % hull.size()] - hull[i]).normalized();
+    const Eigen::Vector2d normal(-d(1), d(0));
+    Eigen::Vector2d min_pt = Eigen::Vector2d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector2d max_pt = -min_pt;
+    for(size_t j=0;j<n;++j)
+    {
+      const Eigen::Vector2d p(d.dot(input[j]), normal.dot(input[j]));
+      min_pt = min_pt.cwiseMin(p);
+      max_pt = max_pt.cwiseMax(p);
+    }
+    min_area = std::min(min_area, (max_pt - min_pt).prod());
+  }
+  //the rectangle encloses the points
+  const Eigen::Vector2d normal(-rectangle.axis(1), rectangle.axis(0));
+  double outside = 0;
+  for(size_t j=0;j<n;++j)
+  {
+    const Eigen::Vector2d p = input[j] - rectangle.center;
+    outside = std::max(outside, std::abs(rectangle.axis.dot(p)) - rectangle.half_extent(0));
+    outside = std::max(outside, std::abs(normal.dot(p)) - rectangle.half_extent(1));
+  }
+  const double error = std::abs(rectangle.area() - min_area) / min_area;
+  std::cout<<n<<" points, "<<hull.size()<<" hull vertices, relative area error: "<<error<<
+             ", outside: "<<outside<<std::endl;
+  return error < 1e-12 && outside < 1e-12;
+}
+
+int main(int argc, char *argv[])
+{
+  srand(7);
+  const size_t n = 1003;
+  std::vector<double> x(n), y(n), z(n);
+  for(size_t i=0;i<n;++i)
+  {
+    x[i] = random_value(-0.2, 0.2);
+    y[i] = random_value(-0.2, 0.2);
+    z[i] = random_value(-0.2, 0.2);
+  }
+  //exact zeros exercise the guarded limits
+  x[0] = 0.0;
+  y[1] = 0.0;
+  z[2] = 0.0;
+
+  double shapes[4][2] = {{1.0, 1.0}, {0.3, 0.8}, {1.5, 0.2}, {0.05, 2.5}};
+  Eigen::Matrix3d rotation = (Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitX()) *
+                              Eigen::AngleAxisd(-0.7, Eigen::Vector3d::UnitZ())).toRotationMatrix();
+  Eigen::Vector3d translation(0.01, -0.02, 0.03);
+
+  bool passed = true;
+  passed &= check_pow(sq::ACCURACY_FULL, 1e-13);
+  passed &= check_pow(sq::ACCURACY_HIGH, 1e-8);
+  passed &= check_pow(sq::ACCURACY_FAST, 2e-4);
+  passed &= check_rectangle(5, 1., 0.);
+  passed &= check_rectangle(2000, 0.3, 0.4);
+  passed &= check_rectangle(2000, 3., -1.2);
+
+  sq::KernelType types[3] = {sq::KERNEL_SCALAR, sq::KERNEL_SSE2, sq::KERNEL_AVX2};
+  for(int t=0;t<3;++t)
+  {
+    if(!sq::sq_set_kernel_type(types[t]))
+    {
+      std::cout<<"kernel "<<types[t]<<" not supported, skipped"<<std::endl;
+      continue;
+    }
+    for(int k=0;k<4;++k)
+    {
+      sq::SQKernelParam param;
+      sq::sq_kernel_param(0.06, 0.09, 0.12, shapes[k][0], shapes[k][1], param);
+      sq::sq_kernel_set_transform(rotation.data(), translation.data(), param);
+      param.accuracy = sq::ACCURACY_FULL;
+      passed &= check_kernel<double>(x, y, z, param, 1e-9);
+      passed &= check_kernel<float>(x, y, z, param, 1e-3);
+      param.accuracy = sq::ACCURACY_HIGH;
+      passed &= check_kernel<double>(x, y, z, param, 1e-6);
+    }
+  }
+  std::cout<<(passed ? "Batch kernels match the scalar residual" : "Batch kernel mismatch")<<std::endl;
+  return passed ? 0 : 1;
+}
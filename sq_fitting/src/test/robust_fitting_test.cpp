@@ -0,0 +1,99 @@
+#include<iostream>
+#include<sq_fitting/robust_fitting.h>
+#include<sq_fitting/sampling.h>
+#include<sq_fitting/sq.h>
+
+#include <pcl/point_types.h>
+#include<algorithm>
+#include<memory>
+#include<random>
+typedef pcl::PointCloud<PointT>::Ptr pointCloudPtr;
+
+//Fits a superquadric cloud with table and clutter outliers, the robust fitting has to
+//recover the size of the superquadric within 1% and leave most outliers out of its inliers
+
+int main(int argc, char *argv[])
+{
+  sq_fitting::sq super;
+  super.a1 = 0.05;
+  super.a2 = 0.08;
+  super.a3 = 0.12;
+  super.e1 = 0.5;
+  super.e2 = 0.8;
+  geometry_msgs::Pose pose;
+  pose.position.x = 0.3;
+  pose.position.y = -0.1;
+  pose.position.z = 0.9;
+  pose.orientation.w = 1.0;
+  super.pose = pose;
+  pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+  std::unique_ptr<SuperquadricSampling> samp(new SuperquadricSampling(super));
+  samp->sample_pilu_fisher();
+  samp->getCloud(cloud);
+
+  pointCloudPtr noisy_cloud(new pcl::PointCloud<PointT>);
+  for(size_t i=0;i<cloud->points.size();i+=40)
+    noisy_cloud->points.push_back(cloud->points[i]);
+  const size_t n_inliers = noisy_cloud->points.size();
+
+  //15% of the points are outliers, half of them on the table below the object
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> uniform(-1., 1.);
+  for(size_t i=0;i<n_inliers*0.18;++i)
+  {
+    PointT point;
+    point.x = pose.position.x + 0.08 * uniform(generator);
+    point.y = pose.position.y + 0.08 * uniform(generator);
+    point.z = pose.position.z - super.a3 - 0.005;
+    if(i % 2)
+      point.z = pose.position.z + 0.2 * uniform(generator);
+    noisy_cloud->points.push_back(point);
+  }
+  noisy_cloud->width = noisy_cloud->points.size();
+  noisy_cloud->height = 1;
+  noisy_cloud->is_dense = true;
+
+  RobustSuperquadricFitting fit(noisy_cloud);
+  fit.set_pose_est_method("pca");
+  fit.fit();
+  sq_fitting::sq param;
+  fit.getMinParams(param);
+  std::vector<int> inliers;
+  fit.getInliers(inliers);
+
+  double expected[3] = {super.a1, super.a2, super.a3};
+  double fitted[3] = {param.a1, param.a2, param.a3};
+  std::sort(expected, expected + 3);
+  std::sort(fitted, fitted + 3);
+  bool passed = true;
+  for(int i=0;i<3;++i)
+  {
+    double relative_error = std::abs(fitted[i] - expected[i]) / expected[i];
+    std::cout<<"Size "<<i<<" expected: "<<expected[i]<<" fitted: "<<fitted[i]<<std::endl;
+    if(relative_error > 0.01)
+      passed = false;
+  }
+  //the outliers are appended after the points of the superquadric
+  const size_t n_outliers = noisy_cloud->points.size() - n_inliers;
+  size_t kept_outliers = 0;
+  for(size_t i=0;i<inliers.size();++i)
+  {
+    if(inliers[i] >= static_cast<int>(n_inliers))
+      ++kept_outliers;
+  }
+  std::cout<<"Inliers: "<<inliers.size()<<" of "<<noisy_cloud->points.size()<<", outliers kept: "
+          <<kept_outliers<<" of "<<n_outliers<<std::endl;
+  if(inliers.size() > n_inliers + n_outliers / 10 || kept_outliers > n_outliers / 10)
+  {
+    std::cout<<"Robust fitting kept the table and clutter points as inliers"<<std::endl;
+    passed = false;
+  }
+
+  if(!passed)
+  {
+    std::cout<<"Robust fitting did not recover the superquadric"<<std::endl;
+    return 1;
+  }
+  std::cout<<"Robust fitting recovered the superquadric"<<std::endl;
+  return 0;
+}
@@ -0,0 +1,469 @@
+#include<iostream>
+#include<sq_fitting/fitting.h>
+#include<sq_fitting/moment_table.h>
+#include<sq_fitting/sampling.h>
+#include<sq_fitting/sq.h>
+
+#include <pcl/point_types.h>
+#include<algorithm>
+#include<limits>
+typedef pcl::PointCloud<PointT>::Ptr pointCloudPtr;
+
+//set by the build to the table shipped in data
+#ifndef SQ_MOMENT_TABLE
+#define SQ_MOMENT_TABLE "data/moment_table.bin"
+#endif
+
+//Fits the same cloud with the qr and the normal equations solvers, both have to reach the
+//same superquadric with every loss. Evaluating the points concurrently, reusing a fitting context
+//or fitting xyz points only must not change the fit, single precision with the double precision
+//polish has to reach the same superquadric. The fit report has to describe the fit, and the
+//resumable fit has to end on the fit of fit().
+//The bounded fit has to recover the sampled superquadric and stay in its bounds. The fit on a
+//support plane has to recover a superquadric standing on a table without its bottom. An
+//ellipsoid has to be fitted by its primitive without Levenberg-Marquardt. The shipped moment
+//table, data/moment_table.bin or the first argument, has to survive saving and loading, hold the
+//shape of the sampled cloud and start the fit from it. Exact normals, without a moment table,
+//must lead the multi start fit to the sampled superquadric. The symmetric fit has to recover a
+//superquadric with a hidden quadrant
+
+pointCloudPtr sample_cloud(const sq_fitting::sq& super, const size_t stride)
+{
+  pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+  SuperquadricSampling samp(super);
+  samp.sample_pilu_fisher();
+  samp.getCloud(cloud);
+  if(stride == 1)
+    return cloud;
+  pointCloudPtr sub_cloud(new pcl::PointCloud<PointT>);
+  for(size_t i=0;i<cloud->points.size();i+=stride)
+    sub_cloud->points.push_back(cloud->points[i]);
+  sub_cloud->width = sub_cloud->points.size();
+  sub_cloud->height = 1;
+  sub_cloud->is_dense = true;
+  return sub_cloud;
+}
+
+//sizes and exponents of the fit within 1 mm and 1e-3 of the expected ones, the first n_sorted
+//sizes sorted since the fit may swap the axes
+bool same_shape(const std::string& name, const sq_fitting::sq& expected, const sq_fitting::sq& fitted,
+                const int n_sorted)
+{
+  double e[5] = {expected.a1, expected.a2, expected.a3, expected.e1, expected.e2};
+  double f[5] = {fitted.a1, fitted.a2, fitted.a3, fitted.e1, fitted.e2};
+  if(n_sorted > 1)
+  {
+    std::sort(e, e + std::min(n_sorted, 3));
+    std::sort(f, f + std::min(n_sorted, 3));
+  }
+  bool passed = true;
+  for(int i=0;i<5;++i)
+  {
+    if(std::abs(e[i] - f[i]) > 1e-3)
+    {
+      std::cout<<name<<" parameter "<<i<<" expected: "<<e[i]<<" fitted: "<<f[i]<<std::endl;
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+bool same_fit(const sq_fitting::sq& a, const sq_fitting::sq& b)
+{
+  return a.a1 == b.a1 && a.a2 == b.a2 && a.a3 == b.a3 && a.e1 == b.e1 && a.e2 == b.e2;
+}
+
+bool check_solvers(const pointCloudPtr& cloud)
+{
+  const std::string losses[2] = {"squared", "huber"};
+  bool passed = true;
+  for(int k=0;k<2;++k)
+  {
+    sq_fitting::sq params[2];
+    const std::string solvers[2] = {"qr", "normal"};
+    for(int s=0;s<2;++s)
+    {
+      SuperquadricFitting fit(cloud);
+      fit.set_pose_est_method("pca");
+      fit.setMultiStart(true, true);
+      fit.set_loss(losses[k]);
+      fit.set_solver(solvers[s]);
+      fit.fit();
+      fit.getMinParams(params[s]);
+    }
+    passed &= same_shape("Loss " + losses[k] + " qr against normal,", params[0], params[1], 0);
+  }
+  if(!passed)
+    std::cout<<"The qr and normal equations solvers reached different superquadrics"<<std::endl;
+  return passed;
+}
+
+bool check_evaluation(const pointCloudPtr& cloud, sq_fitting::sq& reference)
+{
+  sq_fitting::sq params[3];
+  sq::FittingContext context;
+  for(int t=0;t<3;++t)
+  {
+    SuperquadricFitting fit(cloud);
+    fit.set_pose_est_method("pca");
+    fit.setMultiStart(true, true);
+    fit.setParallelThreshold(t == 0 ? 0 : cloud->points.size() + 1);
+    if(t > 0)
+      fit.setContext(&context);
+    fit.fit();
+    fit.getMinParams(params[t]);
+  }
+  reference = params[0];
+  bool passed = true;
+  for(int t=1;t<3;++t)
+  {
+    if(!same_fit(params[0], params[t]))
+    {
+      std::cout<<(t == 1 ? "Parallel evaluation" : "Reusing a context")<<" changed the fit"<<std::endl;
+      passed = false;
+    }
+  }
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr xyz_cloud(new pcl::PointCloud<pcl::PointXYZ>);
+  for(size_t i=0;i<cloud->points.size();++i)
+  {
+    pcl::PointXYZ p;
+    p.x = cloud->points[i].x;
+    p.y = cloud->points[i].y;
+    p.z = cloud->points[i].z;
+    xyz_cloud->points.push_back(p);
+  }
+  xyz_cloud->width = xyz_cloud->points.size();
+  xyz_cloud->height = 1;
+  SuperquadricFittingT<pcl::PointXYZ> fit_xyz(xyz_cloud);
+  fit_xyz.set_pose_est_method("pca");
+  fit_xyz.setMultiStart(true, true);
+  fit_xyz.fit();
+  sq_fitting::sq param_xyz;
+  fit_xyz.getMinParams(param_xyz);
+  if(!same_fit(params[0], param_xyz))
+  {
+    std::cout<<"The point type changed the fit"<<std::endl;
+    passed = false;
+  }
+  return passed;
+}
+
+bool check_float(const pointCloudPtr& cloud, const sq_fitting::sq& reference)
+{
+  sq_fitting::sq param_f;
+  SuperquadricFitting fit_f(cloud);
+  fit_f.set_pose_est_method("pca");
+  fit_f.setMultiStart(true, true);
+  fit_f.set_precision("float");
+  fit_f.fit();
+  fit_f.getMinParams(param_f);
+  SuperquadricFitting::FitReport report;
+  fit_f.getReport(report);
+  double min_error;
+  fit_f.getMinError(min_error);
+  std::cout<<"Iterations: "<<report.iterations<<" evaluations: "<<report.function_evaluations<<" jacobians: "
+          <<report.jacobian_evaluations<<" termination: "<<report.termination<<" error: "<<report.final_error<<std::endl;
+  bool passed = true;
+  if(report.iterations <= 0 || report.n_points != static_cast<int>(cloud->points.size()) ||
+     report.final_error != min_error || !(min_error < 1e-4))
+  {
+    std::cout<<"Fit report is wrong"<<std::endl;
+    passed = false;
+  }
+  if(!same_shape("Single against double precision,", reference, param_f, 0))
+  {
+    std::cout<<"Single precision did not reach the double precision fit"<<std::endl;
+    passed = false;
+  }
+  return passed;
+}
+
+bool check_resumable(const pointCloudPtr& cloud)
+{
+  std::vector<int> budgets;
+  budgets.push_back(500);
+  budgets.push_back(2000);
+  sq_fitting::sq params[2];
+  SuperquadricFitting fit_lm(cloud);
+  fit_lm.set_pose_est_method("pca");
+  fit_lm.setPyramid(budgets);
+  fit_lm.fit();
+  fit_lm.getMinParams(params[0]);
+  SuperquadricFitting fit_step(cloud);
+  fit_step.set_pose_est_method("pca");
+  fit_step.setPyramid(budgets);
+  if(fit_step.getCurrentBest(params[1]))
+  {
+    std::cout<<"Resumable fit returned a superquadric before initStep()"<<std::endl;
+    return false;
+  }
+  fit_step.initStep();
+  int n_steps = 0;
+  while(!fit_step.step(5))
+  {
+    fit_step.getCurrentBest(params[1]);
+    ++n_steps;
+  }
+  fit_step.getMinParams(params[1]);
+  std::cout<<"Resumable fit finished after "<<n_steps + 1<<" steps"<<std::endl;
+  if(!same_fit(params[0], params[1]))
+  {
+    std::cout<<"Resumable fit did not reach the fit of fit()"<<std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool check_bounded(const pointCloudPtr& cloud, const sq_fitting::sq& super)
+{
+  SuperquadricFitting fit_bounded(cloud);
+  fit_bounded.set_pose_est_method("pca");
+  fit_bounded.setMultiStart(true);
+  fit_bounded.setBounds(true);
+  fit_bounded.fit();
+  sq_fitting::sq param_b;
+  fit_bounded.getMinParams(param_b);
+  if(!same_shape("Bounded", super, param_b, 3))
+  {
+    std::cout<<"Bounded fit did not recover the sampled superquadric"<<std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool check_support_plane(const sq_fitting::sq& super)
+{
+  //the same superquadric standing on z = 0, rotated about z, without the points on the table
+  sq_fitting::sq standing = super;
+  standing.pose.position.z = super.a3;
+  standing.pose.orientation.w = cos(0.15);
+  standing.pose.orientation.z = sin(0.15);
+  pointCloudPtr standing_cloud = sample_cloud(standing, 1);
+  pointCloudPtr table_cloud(new pcl::PointCloud<PointT>);
+  for(size_t i=0;i<standing_cloud->points.size();i+=40)
+  {
+    if(standing_cloud->points[i].z > 0.005)
+      table_cloud->points.push_back(standing_cloud->points[i]);
+  }
+  table_cloud->width = table_cloud->points.size();
+  table_cloud->height = 1;
+  table_cloud->is_dense = true;
+  SuperquadricFitting fit_table(table_cloud);
+  fit_table.set_pose_est_method("pca");
+  fit_table.setSupportPlane(Eigen::Vector4d(0., 0., 1., 0.), true);
+  fit_table.fit();
+  sq_fitting::sq param_t;
+  fit_table.getMinParams(param_t);
+  std::cout<<"Support plane fit height: "<<param_t.pose.position.z<<std::endl;
+  bool passed = true;
+  if(std::abs(param_t.pose.position.z - super.a3) > 1e-3)
+  {
+    std::cout<<"Support plane fit height expected: "<<super.a3<<" fitted: "<<param_t.pose.position.z<<std::endl;
+    passed = false;
+  }
+  passed &= same_shape("Support plane", super, param_t, 2);
+  if(!passed)
+    std::cout<<"Support plane fit did not recover the standing superquadric"<<std::endl;
+  return passed;
+}
+
+bool check_primitive(const sq_fitting::sq& super)
+{
+  sq_fitting::sq ellipsoid = super;
+  ellipsoid.e1 = ellipsoid.e2 = 1.;
+  SuperquadricFitting fit_primitive(sample_cloud(ellipsoid, 1));
+  fit_primitive.set_pose_est_method("pca");
+  fit_primitive.setPrimitives(true);
+  fit_primitive.fit();
+  sq_fitting::sq param_p;
+  fit_primitive.getMinParams(param_p);
+  SuperquadricFitting::FitReport report;
+  fit_primitive.getReport(report);
+  std::cout<<"Primitive: "<<report.primitive<<" termination: "<<report.termination<<std::endl;
+  double primitive[3] = {param_p.a1, param_p.a2, param_p.a3};
+  std::sort(primitive, primitive + 3);
+  if(report.primitive != "ellipsoid" || report.termination != "primitive" || report.iterations != 0 ||
+     std::abs(primitive[0] - super.a1) > 1e-3 || std::abs(primitive[1] - super.a2) > 1e-3 ||
+     std::abs(primitive[2] - super.a3) > 1e-3)
+  {
+    std::cout<<"Primitive fit did not recover the ellipsoid"<<std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool check_moment_table(const pointCloudPtr& cloud, const sq_fitting::sq& super, const std::string& shipped_path)
+{
+  //the shipped table, saved and loaded again
+  sq::MomentTable shipped, loaded;
+  const std::string table_path = "/tmp/solver_test_moment_table.bin";
+  if(!shipped.load(shipped_path) || !shipped.save(table_path) || !loaded.load(table_path))
+  {
+    std::cout<<"Moment table "<<shipped_path<<" could not be loaded, saved and loaded again"<<std::endl;
+    return false;
+  }
+  bool passed = true;
+  //the cell of the sampled cloud, pre aligned as by the fitting, has to hold its shape. The
+  //features separate e1 better than e2, whose cells average a wider range of exponents
+  SuperquadricFitting align(cloud);
+  align.set_pose_est_method("pca");
+  align.setPreAlign(true, 0);
+  Eigen::Affine3f transform;
+  Eigen::Vector3f variances;
+  align.preAlign(transform, variances);
+  sq::PointBuffer aligned_points;
+  sq::cloudToBuffer(*cloud, transform.cast<double>(), aligned_points);
+  sq::MomentDescriptor descriptor;
+  sq::momentDescriptor(aligned_points, descriptor);
+  sq::MomentTable::Shape shape;
+  const bool found = loaded.lookup(descriptor, shape);
+  std::cout<<"Moment table shape e1: "<<shape.e1<<" e2: "<<shape.e2<<" size: "<<shape.size.transpose()<<std::endl;
+  //the pre aligned axes are by decreasing variance, the z axis of the superquadric is the longest
+  if(!found || shape.axis != 0 || std::abs(shape.e1 - super.e1) > 0.25 || std::abs(shape.e2 - super.e2) > 0.6 ||
+     std::abs(shape.size(0) - super.a3) > 0.005 || std::abs(shape.size(1) - super.a2) > 0.005 ||
+     std::abs(shape.size(2) - super.a1) > 0.005)
+  {
+    std::cout<<"Moment table lookup is far from the sampled superquadric"<<std::endl;
+    passed = false;
+  }
+  SuperquadricFitting fit_moments(cloud);
+  fit_moments.set_pose_est_method("pca");
+  fit_moments.setMomentTable(&loaded);
+  fit_moments.fit();
+  sq_fitting::sq param_m;
+  fit_moments.getMinParams(param_m);
+  SuperquadricFitting::FitReport report;
+  fit_moments.getReport(report);
+  std::cout<<"Moment table start: "<<report.primitive<<" iterations: "<<report.iterations<<std::endl;
+  if(report.primitive != "moments")
+  {
+    std::cout<<"Moment table did not start the fit"<<std::endl;
+    passed = false;
+  }
+  if(!same_shape("Moment table", super, param_m, 3))
+  {
+    std::cout<<"Fit from the moment table did not recover the sampled superquadric"<<std::endl;
+    passed = false;
+  }
+  return passed;
+}
+
+bool check_normals(const pointCloudPtr& cloud, const sq_fitting::sq& super)
+{
+  //exact normals of the sampled superquadric, from the gradient of its inside outside function,
+  //some of them missing. Without them, the multi start fit ends in a nearby minimum with the
+  //axes of the superquadric swapped
+  const geometry_msgs::Pose& pose = super.pose;
+  pcl::PointCloud<pcl::Normal>::Ptr normals(new pcl::PointCloud<pcl::Normal>);
+  for(size_t i=0;i<cloud->points.size();++i)
+  {
+    const double x = (cloud->points[i].x - pose.position.x) / super.a1;
+    const double y = (cloud->points[i].y - pose.position.y) / super.a2;
+    const double z = (cloud->points[i].z - pose.position.z) / super.a3;
+    const double xy = pow(pow(std::abs(x), 2. / super.e2) + pow(std::abs(y), 2. / super.e2), super.e2 / super.e1 - 1.);
+    Eigen::Vector3d n(xy * pow(std::abs(x), 2. / super.e2 - 1.) / super.a1,
+                      xy * pow(std::abs(y), 2. / super.e2 - 1.) / super.a2,
+                      pow(std::abs(z), 2. / super.e1 - 1.) / super.a3);
+    n = n.cwiseProduct(Eigen::Vector3d(x < 0 ? -1 : 1, y < 0 ? -1 : 1, z < 0 ? -1 : 1)).normalized();
+    if(i % 7 == 0)
+      n.setConstant(std::numeric_limits<double>::quiet_NaN());
+    pcl::Normal normal;
+    normal.normal_x = n(0);
+    normal.normal_y = n(1);
+    normal.normal_z = n(2);
+    normals->points.push_back(normal);
+  }
+  const std::string rotations[2] = {"euler", "so3"};
+  bool passed = true;
+  for(int r=0;r<2;++r)
+  {
+    SuperquadricFitting fit_normals(cloud);
+    fit_normals.set_pose_est_method("pca");
+    fit_normals.set_rotation(rotations[r]);
+    fit_normals.setMultiStart(true, true);
+    fit_normals.setNormals(normals, 0.05);
+    fit_normals.fit();
+    sq_fitting::sq param_n;
+    fit_normals.getMinParams(param_n);
+    SuperquadricFitting::FitReport report;
+    fit_normals.getReport(report);
+    std::cout<<"Normals "<<rotations[r]<<" iterations: "<<report.iterations<<" termination: "<<report.termination<<std::endl;
+    if(!same_shape("Normals " + rotations[r], super, param_n, 3))
+    {
+      std::cout<<"Fit with normals and "<<rotations[r]<<" rotation did not recover the sampled superquadric"<<std::endl;
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+bool check_symmetric(const pointCloudPtr& cloud, const sq_fitting::sq& super)
+{
+  //a quadrant of the superquadric hidden, its bounding box is still centered on the superquadric
+  const geometry_msgs::Pose& pose = super.pose;
+  pointCloudPtr occluded_cloud(new pcl::PointCloud<PointT>);
+  for(size_t i=0;i<cloud->points.size();++i)
+  {
+    if(cloud->points[i].x > pose.position.x || cloud->points[i].y > pose.position.y)
+      occluded_cloud->points.push_back(cloud->points[i]);
+  }
+  occluded_cloud->width = occluded_cloud->points.size();
+  occluded_cloud->height = 1;
+  occluded_cloud->is_dense = true;
+  SuperquadricFitting fit_symmetric(occluded_cloud);
+  fit_symmetric.set_pose_est_method("pca");
+  fit_symmetric.setMultiStart(true);
+  fit_symmetric.setSymmetric(true);
+  fit_symmetric.fit();
+  sq_fitting::sq param_s;
+  fit_symmetric.getMinParams(param_s);
+  std::cout<<"Symmetric fit center: "<<param_s.pose.position.x<<" "<<param_s.pose.position.y<<" "
+          <<param_s.pose.position.z<<std::endl;
+  bool passed = true;
+  if(std::abs(param_s.pose.position.x - pose.position.x) > 1e-3 || std::abs(param_s.pose.position.y - pose.position.y) > 1e-3 ||
+     std::abs(param_s.pose.position.z - pose.position.z) > 1e-3)
+  {
+    std::cout<<"Symmetric fit center expected: "<<pose.position.x<<" "<<pose.position.y<<" "<<pose.position.z<<std::endl;
+    passed = false;
+  }
+  passed &= same_shape("Symmetric", super, param_s, 3);
+  if(!passed)
+    std::cout<<"Symmetric fit did not recover the occluded superquadric"<<std::endl;
+  return passed;
+}
+
+int main(int argc, char *argv[])
+{
+  sq_fitting::sq super;
+  super.a1 = 0.05;
+  super.a2 = 0.08;
+  super.a3 = 0.12;
+  super.e1 = 0.5;
+  super.e2 = 0.8;
+  super.pose.position.x = 0.3;
+  super.pose.position.y = -0.1;
+  super.pose.position.z = 0.9;
+  super.pose.orientation.w = 1.0;
+  pointCloudPtr sub_cloud = sample_cloud(super, 40);
+
+  bool passed = check_solvers(sub_cloud);
+  sq_fitting::sq reference;
+  passed &= check_evaluation(sub_cloud, reference);
+  passed &= check_float(sub_cloud, reference);
+  passed &= check_resumable(sub_cloud);
+  passed &= check_bounded(sub_cloud, super);
+  passed &= check_support_plane(super);
+  passed &= check_primitive(super);
+  passed &= check_moment_table(sub_cloud, super, argc > 1 ? argv[1] : SQ_MOMENT_TABLE);
+  passed &= check_normals(sub_cloud, super);
+  passed &= check_symmetric(sub_cloud, super);
+
+  if(!passed)
+  {
+    std::cout<<"Solvers did not reach the same superquadric"<<std::endl;
+    return 1;
+  }
+  std::cout<<"Solvers reached the same superquadric"<<std::endl;
+  return 0;
+}